@@ -40,7 +40,7 @@ void create_jobs(Region* region, thread_pool* tp, int thread_count, char cmd);
 void init();
 int generate_input(Region* region);
 void generate_stats(Region* region);
-void print_stats();
+void print_stats(Region* region);
 void finalize();
 void init_connected_region_sizes(int** hierarchy);
 List** read_data(int fc);
@@ -66,12 +66,17 @@ int main(int argc, char* argv[]) {
 
 	printf("STARTED\n");
 	Region* region = new_region();
+	new_region_jobs(region, thread_count);
 	printf("region allocated\n");
 
 	spatial_init_region(region, SDR_BASE + SDR_SET);
 	temporal_init_region(region);
 	if (LOAD) {
 		load_region(region, region_id, COLUMN_COUNT, CELL_COUNT);
+		spatial_index_region(region); //loaded inputs may sample different bits
+		spatial_connect_region(region);
+		spatial_find_max_activity(region);
+		temporal_index_region(region);
 	}
 	printf("region initialized\n");
 	int file_count = 0;
@@ -92,43 +97,59 @@ int main(int argc, char* argv[]) {
 				l = data_list[cf];
 				ci = 0;
 			}
-			region->sdr = (SDR*) l->elem;
+			region->sparse_sdr = (SparseSDR*) l->elem;
+			region->sdr = sparse_to_packed(region->sparse_sdr);
 			l = l->next;
 		} else if (read_pipes) {
-			SDR* region_sdr = read_input_from_pipes(read_pipes, connected_region_sizes);
+			PackedSDR* region_sdr = read_input_from_pipes(read_pipes, connected_region_sizes);
 			if (region_sdr == NULL) {
 				break;
 			}
 			region->sdr = region_sdr;
+			region->sparse_sdr = packed_to_sparse(region_sdr);
 		} else {
 			int input = generate_input(region);
-			region->sdr = int_to_sdr(input);
+			region->sparse_sdr = int_to_sparse_sdr(input);
+			region->sdr = sparse_to_packed(region->sparse_sdr);
 		}
 
 		//spatial_give_input(region, 0, COLUMN_COUNT - 1);
 		create_jobs(region, tp, thread_count, 0);
-		spatial_activate_region(region);
+		//spatial_activate_region(region);
+		//spatial_reinforce_region(region);
+		//spatial_region_averages(region);
+		create_jobs(region, tp, thread_count, 7);
+		spatial_merge_histograms(region);
+		create_jobs(region, tp, thread_count, 8); //also reinforces and averages the winners if learning is enabled
+		spatial_merge_winners(region);
 		if (ENABLE_LEARNING) {
-			spatial_reinforce_region(region);
-			spatial_region_averages(region);
 			//spatial_boost_region(region, 0, COLUMN_COUNT - 1);
 			create_jobs(region, tp, thread_count, 1);
 		}
-		temporal_activate_region(region);
+		if (REGION_FUSED_JOBS) {
+			create_jobs(region, tp, thread_count, 10); //also predicts and applies the updates, see temporal_cycle_columns()
+		} else {
+			//temporal_activate_region(region);
+			create_jobs(region, tp, thread_count, 9);
+			temporal_merge_activation(region);
+		}
 		if (give_data) {
 			printf("input: %d:%d\n", cf, ci);
 			ci++;
 		}
 		generate_stats(region);
-		double ratio = region->bursts / ((double) (region->active_columns != NULL ? region->active_columns->len : 0)); //ratio of bursting columns to active columns
-		printf("columns activated: (%d/%d) = %f\n", region->active_columns != NULL ? region->active_columns->len : 0,
+		double ratio = region->bursts / ((double) region->active_column_count); //ratio of bursting columns to active columns
+		printf("columns activated: (%d/%d) = %f\n", region->active_column_count,
 				COLUMN_COUNT,
-				(region->active_columns != NULL ? region->active_columns->len : 0) / ((double) COLUMN_COUNT));
+				region->active_column_count / ((double) COLUMN_COUNT));
 		printf("columns bursted: (%d/%d) = %f\n", region->bursts,
-				region->active_columns != NULL ? region->active_columns->len : 0,
-				((double) region->bursts) / (region->active_columns != NULL ? region->active_columns->len : 0));
-		//temporal_predict_cells(region, 0, COLUMN_COUNT - 1);
-		create_jobs(region, tp, thread_count, 2);
+				region->active_column_count,
+				((double) region->bursts) / region->active_column_count);
+		if (!REGION_FUSED_JOBS) {
+			//temporal_predict_cells(region, 0, COLUMN_COUNT - 1, 0);
+			create_jobs(region, tp, thread_count, 2);
+		}
+		temporal_merge_prediction(region);
 		if (ratio > DETECTION_THRESHOLD) { //if ratio exceeds detection threshold
 			printf("ANOMALY DETECTED\n");
 			temporal_reset_prediction(region);
@@ -138,21 +159,26 @@ int main(int argc, char* argv[]) {
 			last_overlap = region->cycle;
 		}
 		if (ENABLE_LEARNING) {
-			//temporal_apply_updates(region, 0, COLUMN_COUNT - 1);
-			create_jobs(region, tp, thread_count, 3);
+			if (!REGION_FUSED_JOBS) {
+				//temporal_apply_updates(region, 0, COLUMN_COUNT - 1);
+				create_jobs(region, tp, thread_count, 3);
+			}
+			temporal_limit_synapses(region);
 		}
-		//temporal_region_cycle(region, 0, COLUMN_COUNT - 1);
-		create_jobs(region, tp, thread_count, 4);
+		temporal_region_cycle(region); //swaps the cell state buffers, only visits cells with a state
 		temporal_reset_region(region);
 		spatial_reset_region(region);
-		if (ENABLE_LEARNING && region->cycle > 0 && region->cycle % FORGET_INTERVAL == 0) { //run garbage collector
-		//temporal_region_forget_updates(region, 0, COLUMN_COUNT - 1);
+		if (ENABLE_LEARNING && FORGET_BUDGET > 0) { //run garbage collector on a slice of the columns
+			temporal_forget_columns(region);
+		} else if (ENABLE_LEARNING && region->cycle > 0 && region->cycle % FORGET_INTERVAL == 0) { //run garbage collector
+			//temporal_region_forget_updates(region, 0, COLUMN_COUNT - 1);
 			create_jobs(region, tp, thread_count, 5);
 			//temporal_region_forget_segments(region, 0, COLUMN_COUNT - 1);
 			create_jobs(region, tp, thread_count, 6);
 		}
+		free_packed_sdr(region->sdr);
 		if (!give_data) {
-			free_sdr(region->sdr);
+			free_sparse_sdr(region->sparse_sdr);
 		}
 		if (last_overlap == region->cycle - 2) {
 			write_output_to_pipes(region, write_pipes);
@@ -160,7 +186,7 @@ int main(int argc, char* argv[]) {
 		}
 		printf("cycle %ld done\n\n", region->cycle);
 	}
-	print_stats();
+	print_stats(region);
 	if (SAVE) {
 		save_region(region, region_id, COLUMN_COUNT, CELL_COUNT);
 	}
@@ -179,6 +205,7 @@ void create_jobs(Region* region, thread_pool* tp, int thread_count, char cmd) {
 		jobs[a] = new_job();
 		jobs[a]->region = region;
 		jobs[a]->cmd = cmd;
+		jobs[a]->id = a;
 		jobs[a]->from = from;
 		jobs[a]->to = to;
 		schedule_job(tp, jobs[a]);
@@ -206,6 +233,12 @@ void set_parameter(char* param, char* val) {
 		INPUT_PERMANENCE_DEC = atof(val);
 	} else if (strcmp(param, "INPUT_PERMANENCE_CHECK\n") == 0) {
 		INPUT_PERMANENCE_CHECK = atoi(val);
+	} else if (strcmp(param, "INPUT_INVERTED_INDEX\n") == 0) {
+		INPUT_INVERTED_INDEX = atoi(val);
+	} else if (strcmp(param, "INPUT_SORTED_POOL\n") == 0) {
+		INPUT_SORTED_POOL = atoi(val);
+	} else if (strcmp(param, "INPUT_RECEPTIVE_FIELD\n") == 0) {
+		INPUT_RECEPTIVE_FIELD = atoi(val);
 	} else if (strcmp(param, "COLUMN_STIMULUS_THRESHOLD\n") == 0) {
 		COLUMN_STIMULUS_THRESHOLD = atoi(val);
 	} else if (strcmp(param, "COLUMN_MAX_BOOST\n") == 0) {
@@ -242,8 +275,20 @@ void set_parameter(char* param, char* val) {
 		CONNECTION_PERMANENCE_INC = atof(val);
 	} else if (strcmp(param, "CONNECTION_PERMANENCE_DEC\n") == 0) {
 		CONNECTION_PERMANENCE_DEC = atof(val);
+	} else if (strcmp(param, "CONNECTION_REVERSE_INDEX\n") == 0) {
+		CONNECTION_REVERSE_INDEX = atoi(val);
+	} else if (strcmp(param, "REGION_FUSED_JOBS\n") == 0) {
+		REGION_FUSED_JOBS = atoi(val);
 	} else if (strcmp(param, "FORGET_INTERVAL\n") == 0) {
 		FORGET_INTERVAL = atoi(val);
+	} else if (strcmp(param, "FORGET_BUDGET\n") == 0) {
+		FORGET_BUDGET = atoi(val);
+	} else if (strcmp(param, "CELL_MAX_SEGMENTS\n") == 0) {
+		CELL_MAX_SEGMENTS = atoi(val);
+	} else if (strcmp(param, "SEGMENT_MAX_SYNAPSES\n") == 0) {
+		SEGMENT_MAX_SYNAPSES = atoi(val);
+	} else if (strcmp(param, "REGION_MAX_SYNAPSES\n") == 0) {
+		REGION_MAX_SYNAPSES = atol(val);
 	} else if (strcmp(param, "DETECTION_THRESHOLD\n") == 0) {
 		DETECTION_THRESHOLD = atof(val);
 	} else if (strcmp(param, "OVERLAP_THRESHOLD\n") == 0) {
@@ -303,6 +348,7 @@ void read_region_config() {
 void init() {
 	//region config
 	read_region_config();
+	quantize_parameters();
 
 	//global config
 	FILE* global_config;
@@ -406,9 +452,9 @@ void finalize() {
 //update test stats
 void generate_stats(Region* region) {
 	avg_act_columns -= avg_act_columns / (region->cycle + 1);
-	avg_act_columns += (region->active_columns != NULL ? region->active_columns->len : 0)
+	avg_act_columns += region->active_column_count
 			/ ((double) (region->cycle + 1));
-	double ratio = region->bursts / ((double) (region->active_columns != NULL ? region->active_columns->len : 0));
+	double ratio = region->bursts / ((double) region->active_column_count);
 	if (region->cycle > warmup && ratio > DETECTION_THRESHOLD && region->cycle == random_last) {
 		random_detected++;
 	}
@@ -418,7 +464,7 @@ void generate_stats(Region* region) {
 }
 
 //print test stats
-void print_stats() {
+void print_stats(Region* region) {
 	printf("average active columns: %d/%d = %f\n", (int) avg_act_columns, COLUMN_COUNT, avg_act_columns / COLUMN_COUNT);
 	printf("anomalies detected: %d/%d = %f\n", random_detected, random_count,
 			((double) random_detected) / random_count);
@@ -429,6 +475,11 @@ void print_stats() {
 			((double) random_count - random_detected) / random_count);
 	printf("patterns not recognized: %d/%d = %f\n", pattern_failed, terminate - warmup - random_count,
 			((double) pattern_failed) / (terminate - warmup - random_count));
+	printf("garbage collected: %ld segments, %ld synapses, %ld updates\n", region->reclaimed_segments,
+			region->reclaimed_synapses, region->reclaimed_updates);
+	printf("evicted: %ld segments, %ld synapses\n", region->evicted_segments, region->evicted_synapses);
+	printf("temporal memory: %ld segments, %ld synapses, %ld bytes\n", region->segment_count, region->synapse_count,
+			temporal_memory_bytes(region));
 }
 
 void init_connected_region_sizes(int** hierarchy) {
@@ -502,19 +553,11 @@ List** read_data(int fc) {
 			rv = rv < 0 ? 0 : rv >= SDR_BASE ? SDR_BASE - 1 : rv;
 			printf("%d\n", lv);
 			printf("%d\n", rv);
-			SDR* sdr1 = int_to_sdr(lv);
-			SDR* sdr2 = int_to_sdr(rv);
-			char* bits = malloc(sdr1->len + sdr2->len);
-			int a;
-			for (a = 0; a < sdr1->len; a++) {
-				bits[a] = sdr1->bits[a];
-			}
-			for (a = 0; a < sdr2->len; a++) {
-				bits[a + sdr1->len] = sdr2->bits[a];
-			}
-			SDR* val = bits_to_sdr(bits, sdr1->len + sdr2->len);
-			free_sdr(sdr1);
-			free_sdr(sdr2);
+			SparseSDR* sdr1 = int_to_sparse_sdr(lv);
+			SparseSDR* sdr2 = int_to_sparse_sdr(rv);
+			SparseSDR* val = sparse_concat(sdr1, sdr2);
+			free_sparse_sdr(sdr1);
+			free_sparse_sdr(sdr2);
 			l[i] = add_elem((long) val, l[i]);
 		}
 		free(line1);
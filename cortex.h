@@ -3,8 +3,10 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <pthread.h>
 #include "struct_utils.h"
 #include "sdr_utils.h"
+#include "permanence.h"
 
 //based on the following sources:
 //http://numenta.com/biological-and-machine-intelligence/
@@ -17,6 +19,9 @@ double INPUT_PERMANENCE_THRESHOLD;
 double INPUT_PERMANENCE_INC;
 double INPUT_PERMANENCE_DEC;
 char INPUT_PERMANENCE_CHECK; //check input permanence threshold
+char INPUT_INVERTED_INDEX; //compute overlaps by visiting only the inputs sampling active bits
+char INPUT_SORTED_POOL; //sample the input connections of a column in ascending bit order without rejection
+int INPUT_RECEPTIVE_FIELD; //max distance of sampled bits from the column's center, 0 for the whole input, widened to at least INPUT_COUNT bits, requires INPUT_SORTED_POOL
 int COLUMN_STIMULUS_THRESHOLD;
 int COLUMN_MAX_BOOST; //maximum boost value
 int COLUMN_START_BOOST; //cycle at which boosting starts
@@ -35,13 +40,29 @@ double CONNECTION_PERMANENCE_THRESHOLD;
 double CONNECTION_INITIAL_PERMANENCE;
 double CONNECTION_PERMANENCE_INC;
 double CONNECTION_PERMANENCE_DEC;
-int FORGET_INTERVAL; //cycle interval between garbage collector calls
+char CONNECTION_REVERSE_INDEX; //predict by visiting only the synapses to active cells
+char REGION_FUSED_JOBS; //run activation, prediction and update application of the temporal memory in one round of jobs
+int FORGET_INTERVAL; //cycle interval between garbage collector calls, segments, synapses and updates unused for as many cycles are removed
+int FORGET_BUDGET; //columns swept by the garbage collector per cycle, changes when segments are reclaimed, 0 sweeps all columns every FORGET_INTERVAL cycles instead
+int CELL_MAX_SEGMENTS; //segments per cell, the least recently active segment is evicted for a new one, 0 for no limit
+int SEGMENT_MAX_SYNAPSES; //synapses per segment, the weakest synapses are evicted for new ones, 0 for no limit
+long REGION_MAX_SYNAPSES; //synapses of the region, the least recently active segments are evicted above it, 0 for no limit
 double DETECTION_THRESHOLD;
 double OVERLAP_THRESHOLD;
 char ENABLE_LEARNING;
 char LOAD;
 char SAVE;
 
+//permanence parameters converted to perm_t by quantize_parameters()
+perm_t INPUT_PERM_THRESHOLD;
+perm_t INPUT_PERM_INC;
+perm_t INPUT_PERM_DEC;
+perm_t INPUT_PERM_BOOST; //increment of all input permanences of a boosted column
+perm_t CONNECTION_PERM_THRESHOLD;
+perm_t CONNECTION_PERM_INITIAL;
+perm_t CONNECTION_PERM_INC;
+perm_t CONNECTION_PERM_DEC;
+
 int COLUMN_COUNT;
 int INPUT_COUNT;
 int CELL_COUNT;
@@ -50,18 +71,86 @@ typedef struct Region Region;
 typedef struct Column Column;
 typedef struct Cell Cell;
 typedef struct Segment Segment;
-typedef struct Connection Connection;
-typedef struct Input Input;
 typedef struct Update Update;
+typedef struct RegionJob RegionJob;
+typedef struct RegionSlabs RegionSlabs;
+typedef struct SegmentRef SegmentRef;
+typedef struct CellStates CellStates;
+typedef struct CellTimer CellTimer;
+
+#define TARGET_LOCK_COUNT 256 //number of mutexes protecting the reverse index, cell i uses mutex i % TARGET_LOCK_COUNT
+
+//allocators of one thread for the fixed size objects of the temporal memory
+typedef struct RegionSlabs {
+	Slab segments;
+	Arena updates[2]; //updates with their active synapses and new cells, updates of cycle c are stored in updates[c % 2]
+	Slab lists; //List nodes of segments
+	char* scratch; //buffer the garbage collector collects the kept synapses of a cell in, grown as needed
+	size_t scratch_size;
+} RegionSlabs;
+
+//scratch data of one job of the thread pool, jobs write only to their own entry and the main thread merges the entries
+typedef struct RegionJob {
+	int from; //first column of the job
+	int* histogram; //number of the job's columns per overlap value
+	int max_overlap;
+	int* predicted_cells; //cells of the job with a segment reaching the activation threshold, may contain duplicates
+	int predicted_count;
+	int predicted_capacity;
+	int winner_count; //winning columns of the job, stored in active_columns starting at index "from"
+	int average_max_column; //column of the job with the max average activation rate, -1 if none exceeds the previous max
+	double average_max;
+	int bursts; //bursting columns of the job, added to the region's bursts by temporal_merge_activation()
+	unsigned int seed; //state of the job's random stream for rand_r(), so results do not depend on the thread running the job
+} RegionJob;
+
+//cell states of one timestep, bit i is set if cell i is in the state
+//the sparse lists hold the same cells and are collected after each phase that changes the bits
+typedef struct CellStates {
+	PackedSDR* active;
+	PackedSDR* predictive;
+	PackedSDR* learning;
+	SparseSDR* active_cells;
+	SparseSDR* predictive_cells;
+	SparseSDR* learning_cells;
+} CellStates;
 
 typedef struct Region {
 	long cycle;
 	int bursts;
 	double average_max;
+	int average_max_column; //column with the max average activation rate, -1 if none
 	double overlap;
-	List* active_columns;
+	int input_len;
+	int* input_index_offsets; //input_index_offsets[i] to input_index_offsets[i + 1] - 1 are the entries in input_index for input bit i
+	int* input_index; //column index * INPUT_COUNT + input index of every input connection, grouped by bit index, ascending per bit
+	int* active_columns; //indices of the winning columns, ascending
+	int active_column_count;
+	int* overlap_histogram; //number of columns per overlap value, used for inhibition
+	int overlap_threshold; //overlap a column must reach to win, set by spatial_merge_histograms()
+	RegionJob* jobs; //one entry per job of create_jobs()
+	int job_count;
+	pthread_barrier_t* barrier; //synchronizes the phases of temporal_cycle_columns(), counts job_count jobs
+	RegionSlabs* slabs; //one entry per thread, selected by thread_slot
+	int slab_count;
+	long count_cycle; //cycle in which temporal_predict_cells() last counted the segments, -1 if the counts are unknown
+	int forget_column; //next column swept by temporal_forget_columns()
+	long reclaimed_segments; //segments, synapses and updates removed by the garbage collector
+	long reclaimed_synapses;
+	long reclaimed_updates;
+	long segment_count; //segments and synapses of all cells, kept up to date by creation, eviction and the garbage collector
+	long synapse_count;
+	long evicted_segments; //segments and synapses removed to stay within the limits
+	long evicted_synapses;
+	pthread_mutex_t* target_locks; //protect the targets of the cells while updates are applied in parallel
+	CellStates state_buffers[2];
+	CellStates* state; //cell states of the current timestep, points into state_buffers
+	CellStates* prev_state; //cell states of the previous timestep, swapped with state by temporal_region_cycle()
 	Column* columns;
-	SDR* sdr;
+	Cell* cells; //cells of all columns, cell i is cells[i], the cells of column a start at a * CELL_COUNT
+	CellTimer* timers; //timestep states of all cells, timers[i] belongs to cell i
+	PackedSDR* sdr;
+	SparseSDR* sparse_sdr; //indices of the set bits of sdr
 } Region;
 
 typedef struct Column {
@@ -71,76 +160,188 @@ typedef struct Column {
 	int center_index;
 	double average_active;
 	double average_overlap;
-	Input* inputs;
+	long average_cycle; //cycle of the last update of average_active and average_overlap
+	uint64_t* connected; //bit i is set if the input connection to input bit i reaches the permanence threshold
+	int* input_bits; //input connections are stored as separate arrays, input_bits[i] is the bit index of input connection i
+	char* input_active;
+	perm_t* input_perms;
 	Cell* cells;
 } Column;
 
-typedef struct Cell {
-	char active;
-	int remain_active;
-	char prev_active;
-	char predictive;
+//expiry cycles and durations of the states of one cell, kept apart from the cell's segments and synapses
+//the phases visiting the cells with a state only touch these compact entries, looked up by the cell's index
+typedef struct CellTimer {
+	long active_until; //the cell is active in cycles before active_until
+	long predictive_until; //the cell is predictive in cycles before predictive_until
+	long predictive_cycle; //cycle in which predictive_until was last changed
+	long prev_predictive_until; //predictive_until before it was changed in predictive_cycle
+	long learning_until; //the cell is learning in cycles before learning_until
+	int remain_active; //timesteps the active state lasts
 	int remain_predictive;
-	char prev_predictive;
-	char learning;
 	int remain_learning;
-	char prev_learning;
-	int index;
-	List* segment_updates;
+} CellTimer;
+
+typedef struct Cell {
+	int index; //index of the cell in the region, selects its bits in the cell states and its entry in Region.timers
+	Update* segment_updates; //pending updates, newest first
 	List* segments;
+	int synapse_count; //synapses of all segments, stored contiguously segment after segment
+	int synapse_capacity;
+	int* synapse_cells; //index of the presynaptic cell
+	perm_t* synapse_perms;
+	long* synapse_cycles; //cycle in which the synapse was last active
+	SegmentRef* targets; //reverse index: segments with a synapse to this cell, ascending by cell, one entry per synapse
+	int target_count;
+	int target_capacity;
 } Cell;
 
 typedef struct Segment {
 	long active_cycle;
 	char update;
+	long state_cycle; //cycle in which activity, active and learning were computed, the states of other cycles are 0
 	int activity;
 	char active;
-	char prev_active;
+	char prev_active; //active of the cycle before state_cycle
 	char learning;
-	char prev_learning;
-	List* connections;
+	char prev_learning; //learning of the cycle before state_cycle
+	int first; //index of the segment's first synapse in the synapse arrays of its cell
+	int synapse_count;
+	int connected_count; //synapses with a permanence reaching CONNECTION_PERM_THRESHOLD, bounds the segment's activity
+	long count_cycle; //cycle whose cell states the counts below refer to, the counts of segments not counted in a cycle are 0
+	char weak; //connected_count was below SEGMENT_ACTIVATION_THRESHOLD when counted, active_count and learning_count were skipped
+	int active_count; //connected synapses to active cells
+	int potential_count; //synapses to active cells
+	int learning_count; //connected synapses to learning cells
 } Segment;
 
-typedef struct Connection {
-	long active_cycle;
-	Cell* cell;
-	double perm;
-} Connection;
-
-typedef struct Input {
-	int bit_index;
-	char active;
-	double perm;
-} Input;
+typedef struct SegmentRef {
+	int cell; //index of the segment's cell
+	char connected; //the synapse's permanence reaches CONNECTION_PERM_THRESHOLD
+	Segment* segment;
+} SegmentRef;
 
 typedef struct Update {
 	long active_cycle;
 	Segment* segment;
-	List* active_connections;
-	List* new_connections;
-	List* inactive_connections;
+	Update* next; //next older pending update of the cell
+	int synapse_count; //synapses of the segment when the update was created, later synapses are not affected by it
+	uint64_t* active_synapses; //bit i is set if synapse i of the segment was active
+	int active_count;
+	int* new_cells; //presynaptic cells of the synapses to be created
+	int new_count;
 } Update;
 
+//allocates the slabs for "count" threads, existing slabs are kept
+void new_region_slabs(Region* region, int count) {
+	region->slabs = realloc(region->slabs, count * sizeof(RegionSlabs));
+	int a;
+	for (a = region->slab_count; a < count; a++) {
+		init_slab(&(region->slabs[a].segments), sizeof(Segment));
+		init_arena(&(region->slabs[a].updates[0]));
+		init_arena(&(region->slabs[a].updates[1]));
+		init_slab(&(region->slabs[a].lists), sizeof(List));
+		region->slabs[a].scratch = NULL;
+		region->slabs[a].scratch_size = 0;
+	}
+	region->slab_count = count;
+}
+
+//returns the slabs of the calling thread
+RegionSlabs* region_slabs(Region* region) {
+	return &(region->slabs[thread_slot]);
+}
+
 //allocates new region
 Region* new_region() {
 	Region* region = malloc(sizeof(Region));
-	region->active_columns = NULL;
+	region->active_columns = malloc(COLUMN_COUNT * sizeof(int));
+	region->active_column_count = 0;
+	region->overlap_histogram = NULL;
+	region->jobs = NULL;
+	region->job_count = 0;
+	region->barrier = NULL;
+	region->slabs = NULL;
+	region->slab_count = 0;
+	new_region_slabs(region, 1);
+	region->input_index_offsets = NULL;
+	region->input_index = NULL;
 	region->columns = malloc(COLUMN_COUNT * sizeof(Column));
+	region->cells = malloc(COLUMN_COUNT * CELL_COUNT * sizeof(Cell));
+	region->timers = malloc(COLUMN_COUNT * CELL_COUNT * sizeof(CellTimer));
+	region->count_cycle = -1;
+	region->forget_column = 0;
+	region->reclaimed_segments = 0;
+	region->reclaimed_synapses = 0;
+	region->reclaimed_updates = 0;
+	region->segment_count = 0;
+	region->synapse_count = 0;
+	region->evicted_segments = 0;
+	region->evicted_synapses = 0;
+	region->target_locks = malloc(TARGET_LOCK_COUNT * sizeof(pthread_mutex_t));
 	int a;
+	for (a = 0; a < 2; a++) {
+		region->state_buffers[a].active = new_packed_sdr(COLUMN_COUNT * CELL_COUNT);
+		region->state_buffers[a].predictive = new_packed_sdr(COLUMN_COUNT * CELL_COUNT);
+		region->state_buffers[a].learning = new_packed_sdr(COLUMN_COUNT * CELL_COUNT);
+		region->state_buffers[a].active_cells = new_sparse_sdr(COLUMN_COUNT * CELL_COUNT, COLUMN_COUNT * CELL_COUNT);
+		region->state_buffers[a].predictive_cells = new_sparse_sdr(COLUMN_COUNT * CELL_COUNT, COLUMN_COUNT * CELL_COUNT);
+		region->state_buffers[a].learning_cells = new_sparse_sdr(COLUMN_COUNT * CELL_COUNT, COLUMN_COUNT * CELL_COUNT);
+	}
+	region->state = &(region->state_buffers[0]);
+	region->prev_state = &(region->state_buffers[1]);
+	for (a = 0; a < TARGET_LOCK_COUNT; a++) {
+		pthread_mutex_init(&(region->target_locks[a]), NULL);
+	}
 	for (a = 0; a < COLUMN_COUNT; a++) {
 		Column* column = &(region->columns[a]);
-		column->inputs = malloc(INPUT_COUNT * sizeof(Input));
-		column->cells = malloc(CELL_COUNT * sizeof(Cell));
+		column->input_bits = malloc(INPUT_COUNT * sizeof(int));
+		column->input_active = calloc(INPUT_COUNT, sizeof(char));
+		column->input_perms = malloc(INPUT_COUNT * sizeof(perm_t));
+		column->connected = NULL;
+		column->cells = region->cells + a * CELL_COUNT;
 		int b;
 		for (b = 0; b < CELL_COUNT; b++) {
 			Cell* cell = &(column->cells[b]);
 			cell->segment_updates = NULL;
 			cell->segments = NULL;
+			cell->synapse_count = 0;
+			cell->synapse_capacity = 0;
+			cell->synapse_cells = NULL;
+			cell->synapse_perms = NULL;
+			cell->synapse_cycles = NULL;
+			cell->targets = NULL;
+			cell->target_count = 0;
+			cell->target_capacity = 0;
 		}
 	}
 	return region;
 }
 
+//converts the permanence parameters to perm_t, call after reading the config
+void quantize_parameters() {
+	INPUT_PERM_THRESHOLD = perm_quantize(INPUT_PERMANENCE_THRESHOLD);
+	INPUT_PERM_INC = perm_quantize_step(INPUT_PERMANENCE_INC);
+	INPUT_PERM_DEC = perm_quantize_step(INPUT_PERMANENCE_DEC);
+	INPUT_PERM_BOOST = perm_quantize_step(0.1 * INPUT_PERMANENCE_THRESHOLD);
+	CONNECTION_PERM_THRESHOLD = perm_quantize(CONNECTION_PERMANENCE_THRESHOLD);
+	CONNECTION_PERM_INITIAL = perm_quantize(CONNECTION_INITIAL_PERMANENCE);
+	CONNECTION_PERM_INC = perm_quantize_step(CONNECTION_PERMANENCE_INC);
+	CONNECTION_PERM_DEC = perm_quantize_step(CONNECTION_PERMANENCE_DEC);
+}
+
+//allocates the scratch data for "job_count" jobs, call before initializing the region
+void new_region_jobs(Region* region, int job_count) {
+	region->jobs = calloc(job_count, sizeof(RegionJob));
+	region->job_count = job_count;
+	int a;
+	for (a = 0; a < job_count; a++) {
+		region->jobs[a].seed = rand();
+	}
+	region->barrier = malloc(sizeof(pthread_barrier_t));
+	pthread_barrier_init(region->barrier, NULL, job_count);
+	new_region_slabs(region, job_count + 1); //the main thread and one thread of the thread pool per job
+}
+
 //frees region
 void free_region(Region* region) {
 	int a;
@@ -149,54 +350,61 @@ void free_region(Region* region) {
 		int b;
 		for (b = 0; b < CELL_COUNT; b++) {
 			Cell* cell = &(column->cells[b]);
-			List* segments = cell->segments;
-			while (segments != NULL) {
-				Segment* segment = (Segment*) segments->elem;
-				List* connections = segment->connections;
-				while (connections != NULL) {
-					Connection* connection = (Connection*) connections->elem;
-					free(connection);
-					connections = connections->next;
-				}
-				free_list(segment->connections);
-				free(segment);
-				segments = segments->next;
-			}
-			free_list(cell->segments);
-			List* segment_updates = cell->segment_updates;
-			while (segment_updates != NULL) {
-				Update* update = (Update*) segment_updates->elem;
-				List* new_connections = update->new_connections;
-				while (new_connections != NULL) {
-					Connection* connection = (Connection*) new_connections->elem;
-					free(connection);
-					new_connections = new_connections->next;
-				}
-				free_list(update->new_connections);
-				free(update);
-				segment_updates = segment_updates->next;
-			}
-			free_list(cell->segment_updates);
+			free(cell->synapse_cells);
+			free(cell->synapse_perms);
+			free(cell->synapse_cycles);
+			free(cell->targets); //segments, updates and List nodes are released with the slabs
 		}
-		free(column->cells);
+		free(column->input_bits);
+		free(column->input_active);
+		free(column->input_perms);
+		free(column->connected);
 	}
 	free(region->columns);
-	free_list(region->active_columns);
+	free(region->cells);
+	free(region->timers);
+	for (a = 0; a < 2; a++) {
+		free_packed_sdr(region->state_buffers[a].active);
+		free_packed_sdr(region->state_buffers[a].predictive);
+		free_packed_sdr(region->state_buffers[a].learning);
+		free_sparse_sdr(region->state_buffers[a].active_cells);
+		free_sparse_sdr(region->state_buffers[a].predictive_cells);
+		free_sparse_sdr(region->state_buffers[a].learning_cells);
+	}
+	for (a = 0; a < TARGET_LOCK_COUNT; a++) {
+		pthread_mutex_destroy(&(region->target_locks[a]));
+	}
+	free(region->target_locks);
+	free(region->input_index_offsets);
+	free(region->input_index);
+	free(region->active_columns);
+	free(region->overlap_histogram);
+	for (a = 0; a < region->job_count; a++) {
+		free(region->jobs[a].histogram);
+		free(region->jobs[a].predicted_cells);
+	}
+	free(region->jobs);
+	if (region->barrier != NULL) {
+		pthread_barrier_destroy(region->barrier);
+		free(region->barrier);
+	}
+	for (a = 0; a < region->slab_count; a++) {
+		release_slab(&(region->slabs[a].segments));
+		release_arena(&(region->slabs[a].updates[0]));
+		release_arena(&(region->slabs[a].updates[1]));
+		release_slab(&(region->slabs[a].lists));
+		free(region->slabs[a].scratch);
+	}
+	free(region->slabs);
 	free(region);
 }
 
 //debug function, prints predictive state of all cells
 void print_prediction(Region* region) {
 	int a;
-	for (a = 0; a < COLUMN_COUNT; a++) {
-		Column* column = &(region->columns[a]);
-		int b;
-		for (b = 0; b < CELL_COUNT; b++) {
-			Cell* cell = &(column->cells[b]);
-			if (cell->predictive) {
-				printf("%d:%d\n", a, b);
-			}
-		}
+	for (a = 0; a < region->state->predictive_cells->count; a++) {
+		int cell = region->state->predictive_cells->indices[a];
+		printf("%d:%d\n", cell / CELL_COUNT, cell % CELL_COUNT);
 	}
 }
 
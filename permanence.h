@@ -0,0 +1,78 @@
+#ifndef PERMANENCE_H
+#define PERMANENCE_H
+
+#include <stdint.h>
+
+//permanences are stored as perm_t, selected at compile time with -DPERMANENCE_BITS=8 or -DPERMANENCE_BITS=16
+//0 (default) stores doubles in [0, 1], 8 and 16 store fixed point values in [0, PERM_ONE] where PERM_ONE represents 1.0
+//fixed point arithmetic saturates at 0 and PERM_ONE, so clamping is free and updates vectorize with saturating instructions
+
+#ifndef PERMANENCE_BITS
+#define PERMANENCE_BITS 0
+#endif
+
+#if PERMANENCE_BITS == 8
+typedef uint8_t perm_t;
+#define PERM_ONE 255
+#elif PERMANENCE_BITS == 16
+typedef uint16_t perm_t;
+#define PERM_ONE 65535
+#elif PERMANENCE_BITS == 0
+typedef double perm_t;
+#define PERM_ONE 1.0
+#else
+#error "PERMANENCE_BITS must be 0, 8 or 16"
+#endif
+
+//converts a permanence in [0, 1] to perm_t, values outside are clamped
+
+perm_t perm_quantize(double value) {
+	value = value < 0.0 ? 0.0 : value > 1.0 ? 1.0 : value;
+#if PERMANENCE_BITS == 0
+	return value;
+#else
+	return (perm_t) (value * PERM_ONE + 0.5);
+#endif
+}
+
+//converts a permanence increment or decrement to perm_t, positive steps never round to 0 so learning cannot stall
+
+perm_t perm_quantize_step(double value) {
+	perm_t step = perm_quantize(value);
+#if PERMANENCE_BITS != 0
+	if (step == 0 && value > 0.0) {
+		step = 1;
+	}
+#endif
+	return step;
+}
+
+//converts a perm_t to a permanence in [0, 1]
+
+double perm_value(perm_t perm) {
+	return perm / (double) PERM_ONE;
+}
+
+//adds "inc" to the permanence, saturates at PERM_ONE
+
+perm_t perm_add(perm_t perm, perm_t inc) {
+#if PERMANENCE_BITS == 0
+	perm += inc;
+	return perm > 1.0 ? 1.0 : perm;
+#else
+	return perm > PERM_ONE - inc ? PERM_ONE : perm + inc;
+#endif
+}
+
+//subtracts "dec" from the permanence, saturates at 0
+
+perm_t perm_sub(perm_t perm, perm_t dec) {
+#if PERMANENCE_BITS == 0
+	perm -= dec;
+	return perm < 0.0 ? 0.0 : perm;
+#else
+	return perm < dec ? 0 : perm - dec;
+#endif
+}
+
+#endif
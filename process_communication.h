@@ -196,24 +196,19 @@ void close_write_pipes(List* pipe_list, int** hierarchy, int number_regions, int
 	free_list(pipe_list);
 }
 
-/* Invoked by lower level regions. Writes the cycle and predictive states of the lower region into the pipe */
+/* Invoked by lower level regions. Writes the cycle and predictive states of the lower region into the pipe.
+ The predictive states are transmitted bit-packed (one bit per cell, 64 cells per word) */
 void write_output_to_pipes(Region* region, List* write_pipes) {
-	char* region_sdr = malloc(sizeof(char) * CELL_COUNT * COLUMN_COUNT);
-	for (int i = 0; i < COLUMN_COUNT; i++) {
-		for (int j = 0; j < CELL_COUNT; j++) {
-			region_sdr[i * CELL_COUNT + j] = (region->columns)[i].cells[j].prev_predictive;
-		}
-	}
+	PackedSDR* region_sdr = region->prev_state->predictive; //cell i is bit i, already in the transmitted layout
 
 	for (List* pipes = write_pipes; pipes; pipes = pipes->next) {
 		write(pipes->elem, &region->cycle, sizeof(int));
-		write(pipes->elem, region_sdr, sizeof(char) * CELL_COUNT * COLUMN_COUNT);
+		write(pipes->elem, region_sdr->words, sizeof(uint64_t) * region_sdr->word_count);
 	}
-	free(region_sdr);
 }
 
-// reads the input from all incoming pipes and concats them to an SDR
-SDR* read_input_from_pipes(List* read_pipes, int** crs) { //crs = connected_region_sizes
+// reads the input from all incoming pipes and concats them to a packed SDR
+PackedSDR* read_input_from_pipes(List* read_pipes, int** crs) { //crs = connected_region_sizes
 	int len = read_pipes->len;
 	int full_size = 0;
 	int max_size = 0;
@@ -223,7 +218,6 @@ SDR* read_input_from_pipes(List* read_pipes, int** crs) { //crs = connected_regi
 		max_size = max_size < crs[i][0] * crs[i][1] ? crs[i][0] * crs[i][1] : max_size; // Size for union
 	}
 
-	char* region_bits = malloc(sizeof(char) * full_size);
 	int current_position = 0;
 	int i = 0;
 	char flag = 1;
@@ -235,43 +229,39 @@ SDR* read_input_from_pipes(List* read_pipes, int** crs) { //crs = connected_regi
 	}
 	if (flag) {
 		return NULL;
-		free(region_bits);
 	}
 
-	//reads cycle and predictive states from read pipes and writes them to array -> then converted to SDR
+	PackedSDR* region_sdr = new_packed_sdr(full_size);
+	uint64_t* region_words = malloc(sizeof(uint64_t) * ((max_size + 63) / 64));
+	//reads cycle and packed predictive states from read pipes and copies them to their position in the SDR
 	for (List* pipes = read_pipes; pipes; pipes = pipes->next) {
+		int size = crs[i][0] * crs[i][1];
 		if (!lowerRegionDone[i]) {
 			read(pipes->elem, &cycle, sizeof(int));
 			printf("region: %i            cycle: %i\n", i, cycle);
-			read(pipes->elem, region_bits + sizeof(char) * current_position, sizeof(char) * crs[i][0] * crs[i][1]);
-			if (*(region_bits + sizeof(char) + current_position) == -1) {
+			read(pipes->elem, region_words, sizeof(uint64_t) * ((size + 63) / 64));
+			if (cycle == -1) {
 				lowerRegionDone[i] = 1;
-				for (int j = 0; j < crs[i][0] * crs[i][1]; j++) {
-					*(region_bits + current_position + j * sizeof(char)) = 0;
-				}
+			} else {
+				packed_copy_bits(region_sdr, current_position, region_words, size);
 			}
 		}
-		current_position += crs[i][0] * crs[i][1];
+		current_position += size;
 		i++;
 	}
-	SDR* region_sdr = bits_to_sdr(region_bits, sizeof(char) * full_size);
+	free(region_words);
 	return region_sdr;
 }
 
 // writes a signal of the finished region upwards (-1) and thus stops termination of higher region.
 void write_end_signal(List* write_pipes) {
-	char* region_sdr = malloc(sizeof(char) * CELL_COUNT * COLUMN_COUNT);
-	for (int i = 0; i < COLUMN_COUNT; i++) {
-		for (int j = 0; j < CELL_COUNT; j++) {
-			region_sdr[i * CELL_COUNT + j] = -1;
-		}
-	}
+	PackedSDR* region_sdr = new_packed_sdr(CELL_COUNT * COLUMN_COUNT);
 	int cycle = -1;
 	for (List* pipes = write_pipes; pipes; pipes = pipes->next) {
 		write(pipes->elem, &cycle, sizeof(int));
-		write(pipes->elem, region_sdr, sizeof(char) * CELL_COUNT * COLUMN_COUNT);
+		write(pipes->elem, region_sdr->words, sizeof(uint64_t) * region_sdr->word_count);
 	}
-	free(region_sdr);
+	free_packed_sdr(region_sdr);
 	printf("Wrote end signals\n");
 }
 #endif
@@ -12,6 +12,8 @@
 #include <errno.h>
 #include "struct_utils.h"
 #include "cortex.h"
+#include "spatial_pooler.h"
+#include "temporal_memory.h"
 #include "process_communication.h"
 
 FILE* file;
@@ -24,40 +26,49 @@ long index_of_Column(Region* r, Column* co, int num_Columns, int num_Cells) {
 	return col_off;
 }
 
-void save_connection(Region* r, Segment* s, Column* co, Cell* ce, Connection* con, int num_Columns, int num_Cells) {
-	fprintf(file, "1 %ld %d %lf\n", con->active_cycle, con->cell->index, con->perm);
+void save_synapse(Region* r, Segment* s, Column* co, Cell* ce, int synapse, int num_Columns, int num_Cells) {
+	fprintf(file, "1 %ld %d %lf\n", ce->synapse_cycles[synapse], ce->synapse_cells[synapse], perm_value(ce->synapse_perms[synapse]));
 }
 
 void save_segment(Region* r, Segment* s, Column* co, Cell* ce, int num_Columns, int num_Cells) {
+	temporal_segment_rollover(s, r->cycle); //saves store the states as of the current cycle
 	fprintf(file, "1 %ld %d %d %d %d %d %d\n", s->active_cycle, s->update, s->activity, s->active, s->prev_active,
 			s->learning, s->prev_learning);
-	for (List* i = s->connections; i; i = i->next) {
-		save_connection(r, s, co, ce, (Connection*) i->elem, num_Columns, num_Cells);
+	for (int i = s->first; i < s->first + s->synapse_count; i++) {
+		save_synapse(r, s, co, ce, i, num_Columns, num_Cells);
 	}
 	fprintf(file, "-1 \n");
 }
 
 void save_cell(Region* r, Cell* ce, Column* co, int num_Columns, int num_Cells) {
-	fprintf(file, "%d %d %d %d %d %d %d %d %d\n", ce->active, ce->remain_active, ce->prev_active, ce->predictive,
-			ce->remain_predictive, ce->prev_predictive, ce->learning, ce->remain_learning, ce->prev_learning);
+	int index = ce->index;
+	CellTimer* t = &r->timers[index];
+	long cycle = r->cycle;
+	//states are saved as remaining timesteps, the states of the previous timestep as remaining timesteps back then
+	fprintf(file, "%d %d %d %d %d %d %d %d %d\n", packed_is_set(r->state->active, index) ? (int) (t->active_until - cycle) : 0,
+			t->remain_active, packed_is_set(r->prev_state->active, index) ? (int) (t->active_until - cycle + 1) : 0,
+			packed_is_set(r->state->predictive, index) ? (int) (t->predictive_until - cycle) : 0, t->remain_predictive,
+			packed_is_set(r->prev_state->predictive, index) ? (int) (temporal_prev_predictive_until(r, index) - cycle + 1) : 0,
+			packed_is_set(r->state->learning, index) ? (int) (t->learning_until - cycle) : 0, t->remain_learning,
+			packed_is_set(r->prev_state->learning, index) ? (int) (t->learning_until - cycle + 1) : 0);
 	for (List* i = ce->segments; i; i = i->next) {
 		save_segment(r, (Segment*) i->elem, co, ce, num_Columns, num_Cells);
 	}
 	fprintf(file, "-1 \n");
 }
 
-void save_input(Input* in) {
-	fprintf(file, "%d %d %lf\n", in->bit_index, in->active, in->perm);
+void save_input(Column* co, int in) {
+	fprintf(file, "%d %d %lf\n", co->input_bits[in], co->input_active[in], perm_value(co->input_perms[in]));
 }
 
 void save_column(Region* r, Column* co, int num_Columns, int num_Cells, int current_col) {
 	fprintf(file, "%d %d %d %d %d %lf %lf\n", current_col, co->active, co->overlap, co->boost, co->center_index,
-			co->average_active, co->average_overlap);
+			spatial_average_active(co, r->cycle - 1), spatial_average_overlap(co, r->cycle - 1));
 	for (int i = 0; i < num_Cells / num_Columns; i++) {
 		save_cell(r, &co->cells[i], co, num_Columns, num_Cells);
 	}
 	for (int i = 0; i < INPUT_COUNT; i++) {
-		save_input(&co->inputs[i]);
+		save_input(co, i);
 	}
 }
 
@@ -78,8 +89,8 @@ void save_region(Region* region, int region_id, int num_Columns, int num_Cells)
 	printf("\nSaving Region: %s\n", save_name);
 
 	fprintf(file, "%ld %d %lf %lf\n", region->cycle, region->bursts, region->average_max, region->overlap);
-	for (List* i = region->active_columns; i; i = i->next) {
-		fprintf(file, "%ld ", i->elem);
+	for (int i = 0; i < region->active_column_count; i++) {
+		fprintf(file, "%d ", region->active_columns[i]);
 	}
 	fprintf(file, "-1\n");
 	for (int i = 0; i < num_Columns; i++) {
@@ -89,10 +100,16 @@ void save_region(Region* region, int region_id, int num_Columns, int num_Cells)
 	printf("Region saved\n");
 }
 
-void load_connection(Region* r, Segment* s, Column* co, Cell* ce, Connection* con, int num_Columns, int num_Cells) {
-	long index;
-	fscanf(file, "%ld %ld %lf\n", &con->active_cycle, &index, &con->perm);
-	con->cell = &(&r->columns[index / num_Cells])->cells[index % num_Cells];
+void load_synapse(Region* r, Segment* s, Column* co, Cell* ce, int num_Columns, int num_Cells) {
+	int synapse = s->first + s->synapse_count; //segments are loaded one after another, so the segment's synapses end the cell's arrays
+	double perm;
+	temporal_reserve_synapses(ce, 1);
+	fscanf(file, "%ld %d %lf\n", &ce->synapse_cycles[synapse], &ce->synapse_cells[synapse], &perm);
+	ce->synapse_perms[synapse] = perm_quantize(perm); //saves store permanences in [0, 1] independent of PERMANENCE_BITS
+	s->connected_count += ce->synapse_perms[synapse] >= CONNECTION_PERM_THRESHOLD;
+	s->synapse_count++;
+	ce->synapse_count++;
+	r->synapse_count++;
 }
 
 void load_segment(Region* r, Segment* s, Column* co, Cell* ce, int num_Columns, int num_Cells) {
@@ -102,43 +119,69 @@ void load_segment(Region* r, Segment* s, Column* co, Cell* ce, int num_Columns,
 		printf("1 %ld %c %d %c %c %c %c\n", s->active_cycle, s->update, s->activity, s->active, s->prev_active,
 				s->learning, s->prev_learning);
 	int i;
+	s->state_cycle = r->cycle;
+	s->first = ce->synapse_count;
+	s->synapse_count = 0;
+	s->connected_count = 0;
+	s->count_cycle = -1;
 	for (fscanf(file, "%d ", &i); i > -1; fscanf(file, "%d ", &i)) {
-		Connection* con = malloc(sizeof(Connection));
-		load_connection(r, s, co, ce, con, num_Columns, num_Cells);
-		s->connections = add_elem((long) con, s->connections);
+		load_synapse(r, s, co, ce, num_Columns, num_Cells);
 	}
 }
 
 void load_cell(Region* r, Cell* ce, Column* co, int num_Columns, int num_Cells) {
-	fscanf(file, "%d %d %d %d %d %d %d %d %d\n", &ce->active, &ce->remain_active, &ce->prev_active, &ce->predictive,
-			&ce->remain_predictive, &ce->prev_predictive, &ce->learning, &ce->remain_learning, &ce->prev_learning);
+	int active, prev_active, predictive, prev_predictive, learning, prev_learning;
+	CellTimer* t = &r->timers[ce->index];
+	fscanf(file, "%d %d %d %d %d %d %d %d %d\n", &active, &t->remain_active, &prev_active, &predictive,
+			&t->remain_predictive, &prev_predictive, &learning, &t->remain_learning, &prev_learning);
 	int i;
 	if (debugprint)
-		printf("%c %d %c %c %d %c %c %d %c\n", ce->active, ce->remain_active, ce->prev_active, ce->predictive,
-				ce->remain_predictive, ce->prev_predictive, ce->learning, ce->remain_learning, ce->prev_learning);
+		printf("%d %d %d %d %d %d %d %d %d\n", active, t->remain_active, prev_active, predictive,
+				t->remain_predictive, prev_predictive, learning, t->remain_learning, prev_learning);
+	t->active_until = active ? r->cycle + active : 0; //remaining timesteps to expiry cycles
+	t->predictive_until = predictive ? r->cycle + predictive : prev_predictive ? r->cycle - 1 + prev_predictive : 0;
+	t->predictive_cycle = -1;
+	t->learning_until = learning ? r->cycle + learning : 0;
+	if (active)
+		packed_set(r->state->active, ce->index);
+	if (prev_active)
+		packed_set(r->prev_state->active, ce->index);
+	if (predictive)
+		packed_set(r->state->predictive, ce->index);
+	if (prev_predictive)
+		packed_set(r->prev_state->predictive, ce->index);
+	if (learning)
+		packed_set(r->state->learning, ce->index);
+	if (prev_learning)
+		packed_set(r->prev_state->learning, ce->index);
 	for (fscanf(file, "%d ", &i); i > -1; fscanf(file, "%d ", &i)) {
 		if (debugprint)
 			printf("%d ", i);
-		Segment* s = malloc(sizeof(Segment));
-		s->connections = NULL;
+		Segment* s = slab_alloc(&(region_slabs(r)->segments));
 		load_segment(r, s, co, ce, num_Columns, num_Cells);
-		ce->segments = add_elem((long) s, ce->segments);
+		ce->segments = add_slab_elem((long) s, ce->segments, &(region_slabs(r)->lists));
+		r->segment_count++;
 	}
 }
 
-void load_input(Input* in) {
-	fscanf(file, "%d %d %lf\n", &in->bit_index, &in->active, &in->perm);
+void load_input(Column* co, int in) {
+	int active;
+	double perm;
+	fscanf(file, "%d %d %lf\n", &co->input_bits[in], &active, &perm);
+	co->input_active[in] = active;
+	co->input_perms[in] = perm_quantize(perm);
 }
 
 void load_column(Region* r, Column* co, int num_Columns, int num_Cells) {
 	int colnum;
 	fscanf(file, "%d %d %d %d %d %lf %lf\n", &colnum, &co->active, &co->overlap, &co->boost, &co->center_index,
 			&co->average_active, &co->average_overlap);
+	co->average_cycle = r->cycle - 1; //averages are saved as of the last finished cycle
 	for (int i = 0; i < num_Cells / num_Columns; i++) {
 		load_cell(r, &co->cells[i], co, num_Columns, num_Cells);
 	}
 	for (int i = 0; i < INPUT_COUNT; i++) {
-		load_input(&co->inputs[i]);
+		load_input(co, i);
 	}
 }
 
@@ -163,11 +206,16 @@ void load_region(Region* region, int region_id, int num_Columns, int num_Cells)
 	fscanf(file, "%ld %d %lf %lf\n", &region->cycle, &region->bursts, &region->average_max, &region->overlap);
 	long i;
 	for (fscanf(file, "%ld ", &i); i > -1; fscanf(file, "%ld ", &i)) {
-		region->active_columns = add_elem(i, region->active_columns);
+		region->active_columns[region->active_column_count++] = i;
 	}
 	for (int i = 0; i < num_Columns; i++) {
 		load_column(region, &region->columns[i], num_Columns, num_Cells);
 	}
+	long duplicates = temporal_dedupe_region(region);
+	if (duplicates > 0) {
+		printf("%ld duplicate synapses merged\n", duplicates);
+	}
+	temporal_collect_cells(region);
 
 	printf("Region loaded\n");
 }
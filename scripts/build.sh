@@ -1,5 +1,5 @@
 #!/bin/bash
 
 echo compiling HTH.c
-gcc -pthread ../HTM.c -o ../HTM.out
+gcc -pthread -O3 -march=native ../HTM.c -o ../HTM.out -lm
 echo compiled
@@ -3,6 +3,8 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include "struct_utils.h"
 
 //based on the following sources:
@@ -10,6 +12,12 @@
 //http://numenta.com/assets/pdf/biological-and-machine-intelligence/0.4/BaMI-SDR.pdf
 //http://numenta.com/assets/pdf/biological-and-machine-intelligence/0.4/BaMI-Encoders.pdf
 
+//packed_is_set() is called from the overlap and activation loops, its range check is only compiled in with -DSDR_CHECK_INDICES=1
+
+#ifndef SDR_CHECK_INDICES
+#define SDR_CHECK_INDICES 0
+#endif
+
 int SDR_BASE; //amount of different values that can be represented
 int SDR_SET; //amount of set bits
 
@@ -18,6 +26,20 @@ typedef struct SDR {
 	char* bits;
 } SDR;
 
+//bit-packed SDR, bit i is stored in word i / 64 at position i % 64, bits beyond len are always 0
+typedef struct PackedSDR {
+	int len; //number of bits
+	int word_count; //number of 64 bit words
+	uint64_t* words;
+} PackedSDR;
+
+//sparse SDR, holds only the indices of the set bits in ascending order
+typedef struct SparseSDR {
+	int len; //number of bits
+	int count; //number of set bits
+	int* indices;
+} SparseSDR;
+
 //deallocates the input SDR
 
 void free_sdr(SDR* sdr) {
@@ -93,4 +115,351 @@ SDR* sdr_union(SDR* sdr1, SDR* sdr2) {
 	}
 	return sdr;
 }
+
+//returns a new packed SDR of length len with all bits set to 0
+
+PackedSDR* new_packed_sdr(int len) {
+	PackedSDR* sdr = malloc(sizeof(PackedSDR));
+	sdr->len = len;
+	sdr->word_count = (len + 63) / 64;
+	sdr->words = calloc(sdr->word_count, sizeof(uint64_t));
+	return sdr;
+}
+
+//deallocates the input packed SDR
+
+void free_packed_sdr(PackedSDR* sdr) {
+	free(sdr->words);
+	free(sdr);
+}
+
+//sets the bit at index, index must be >= 0 and < len
+
+void packed_set(PackedSDR* sdr, int index) {
+	sdr->words[index >> 6] |= ((uint64_t) 1) << (index & 63);
+}
+
+//sets the bit at index like packed_set(), safe if other threads set bits of the same word concurrently
+
+void packed_set_atomic(PackedSDR* sdr, int index) {
+	__atomic_fetch_or(&(sdr->words[index >> 6]), ((uint64_t) 1) << (index & 63), __ATOMIC_RELAXED);
+}
+
+//sets all bits to 0
+
+void packed_clear(PackedSDR* sdr) {
+	memset(sdr->words, 0, sdr->word_count * sizeof(uint64_t));
+}
+
+//returns the index of the first set bit at or after index, -1 if there is none
+
+int packed_next(PackedSDR* sdr, int index) {
+	if (index >= sdr->len) {
+		return -1;
+	}
+	int a = index >> 6;
+	uint64_t word = sdr->words[a] & (~((uint64_t) 0) << (index & 63));
+	while (word == 0) {
+		if (++a >= sdr->word_count) {
+			return -1;
+		}
+		word = sdr->words[a];
+	}
+	return (a << 6) + __builtin_ctzll(word);
+}
+
+//returns 1 if bit at index is set, otherwise 0, index must be >= 0 and < len
+
+static inline char packed_is_set(PackedSDR* sdr, int index) {
+#if SDR_CHECK_INDICES
+	if (index < 0 || index >= sdr->len) {
+		printf("INVALID INDEX: %d\n", index);
+		fflush(stdout);
+		return 0;
+	}
+#endif
+	return (sdr->words[index >> 6] >> (index & 63)) & 1;
+}
+
+//returns a new packed SDR representing the input integer, integer must be >= 0 and < SDR_BASE
+
+PackedSDR* int_to_packed_sdr(int i) {
+	if (i < 0 || i >= SDR_BASE) {
+		printf("INVALID INTEGER: %d\n", i);
+		return NULL;
+	}
+	PackedSDR* sdr = new_packed_sdr(SDR_BASE + SDR_SET);
+	int a;
+	for (a = i; a < i + SDR_SET; a++) { //sets bits at indices between i and i + SDR_SET to 1
+		packed_set(sdr, a);
+	}
+	return sdr;
+}
+
+//returns a new packed SDR with the same bits as the input SDR
+
+PackedSDR* sdr_to_packed(SDR* sdr) {
+	PackedSDR* packed = new_packed_sdr(sdr->len);
+	int a;
+	for (a = 0; a < sdr->len; a++) {
+		if (sdr->bits[a] == 1) {
+			packed_set(packed, a);
+		}
+	}
+	return packed;
+}
+
+//returns a new SDR with the same bits as the input packed SDR
+
+SDR* packed_to_sdr(PackedSDR* packed) {
+	char* bits = malloc(packed->len * sizeof(char));
+	int a;
+	for (a = 0; a < packed->len; a++) {
+		bits[a] = (packed->words[a >> 6] >> (a & 63)) & 1;
+	}
+	return bits_to_sdr(bits, packed->len);
+}
+
+//ORs the first len bits of the word array src into the packed SDR, starting at bit index offset
+
+void packed_copy_bits(PackedSDR* sdr, int offset, uint64_t* src, int len) {
+	int shift = offset & 63;
+	int first = offset >> 6;
+	int a;
+	for (a = 0; a < (len + 63) / 64; a++) {
+		uint64_t word = src[a];
+		if (a == len / 64) { //mask out bits beyond len in the last word
+			word &= (((uint64_t) 1) << (len & 63)) - 1;
+		}
+		sdr->words[first + a] |= word << shift;
+		if (shift != 0 && first + a + 1 < sdr->word_count) {
+			sdr->words[first + a + 1] |= word >> (64 - shift);
+		}
+	}
+}
+
+//returns a new packed SDR that is the concatenation of the input packed SDRs
+
+PackedSDR* packed_concat(PackedSDR* sdr1, PackedSDR* sdr2) {
+	PackedSDR* sdr = new_packed_sdr(sdr1->len + sdr2->len);
+	packed_copy_bits(sdr, 0, sdr1->words, sdr1->len);
+	packed_copy_bits(sdr, sdr1->len, sdr2->words, sdr2->len);
+	return sdr;
+}
+
+//returns the number of set bits of the packed SDR
+
+int packed_count(PackedSDR* sdr) {
+	int count = 0;
+	int a;
+	for (a = 0; a < sdr->word_count; a++) {
+		count += __builtin_popcountll(sdr->words[a]);
+	}
+	return count;
+}
+
+//returns the overlap of both input packed SDRs
+
+int packed_overlap(PackedSDR* sdr1, PackedSDR* sdr2) {
+	int overlap = 0;
+	int a;
+	for (a = 0; a < sdr1->word_count && a < sdr2->word_count; a++) {
+		overlap += __builtin_popcountll(sdr1->words[a] & sdr2->words[a]);
+	}
+	return overlap;
+}
+
+//returns a new packed SDR that is the union of input packed SDRs
+
+PackedSDR* packed_union(PackedSDR* sdr1, PackedSDR* sdr2) {
+	PackedSDR* sdr = new_packed_sdr(sdr1->len >= sdr2->len ? sdr1->len : sdr2->len);
+	int a;
+	for (a = 0; a < sdr->word_count; a++) {
+		sdr->words[a] = (a < sdr1->word_count ? sdr1->words[a] : 0) | (a < sdr2->word_count ? sdr2->words[a] : 0);
+	}
+	return sdr;
+}
+
+//returns a new packed SDR that is the intersection of input packed SDRs
+
+PackedSDR* packed_intersection(PackedSDR* sdr1, PackedSDR* sdr2) {
+	PackedSDR* sdr = new_packed_sdr(sdr1->len <= sdr2->len ? sdr1->len : sdr2->len);
+	int a;
+	for (a = 0; a < sdr->word_count; a++) {
+		sdr->words[a] = sdr1->words[a] & sdr2->words[a];
+	}
+	return sdr;
+}
+
+//returns a new sparse SDR of length len with space for count set bits
+
+SparseSDR* new_sparse_sdr(int len, int count) {
+	SparseSDR* sdr = malloc(sizeof(SparseSDR));
+	sdr->len = len;
+	sdr->count = 0;
+	sdr->indices = malloc((count > 0 ? count : 1) * sizeof(int));
+	return sdr;
+}
+
+//deallocates the input sparse SDR
+
+void free_sparse_sdr(SparseSDR* sdr) {
+	free(sdr->indices);
+	free(sdr);
+}
+
+//returns a new sparse SDR representing the input integer, integer must be >= 0 and < SDR_BASE
+
+SparseSDR* int_to_sparse_sdr(int i) {
+	if (i < 0 || i >= SDR_BASE) {
+		printf("INVALID INTEGER: %d\n", i);
+		return NULL;
+	}
+	SparseSDR* sdr = new_sparse_sdr(SDR_BASE + SDR_SET, SDR_SET);
+	int a;
+	for (a = 0; a < SDR_SET; a++) { //sets bits at indices between i and i + SDR_SET
+		sdr->indices[a] = i + a;
+	}
+	sdr->count = SDR_SET;
+	return sdr;
+}
+
+//returns 1 if bit at index is set, otherwise 0
+
+char sparse_is_set(SparseSDR* sdr, int index) {
+	int low = 0;
+	int high = sdr->count - 1;
+	while (low <= high) { //binary search in the sorted indices
+		int mid = (low + high) / 2;
+		if (sdr->indices[mid] == index) {
+			return 1;
+		} else if (sdr->indices[mid] < index) {
+			low = mid + 1;
+		} else {
+			high = mid - 1;
+		}
+	}
+	return 0;
+}
+
+//returns the position of the first index >= index, count if there is none
+
+int sparse_lower_bound(SparseSDR* sdr, int index) {
+	int low = 0;
+	int high = sdr->count;
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if (sdr->indices[mid] < index) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+//returns the overlap of both input sparse SDRs
+
+int sparse_overlap(SparseSDR* sdr1, SparseSDR* sdr2) {
+	int overlap = 0;
+	int a = 0;
+	int b = 0;
+	while (a < sdr1->count && b < sdr2->count) { //merge both sorted index arrays
+		if (sdr1->indices[a] == sdr2->indices[b]) {
+			overlap++;
+			a++;
+			b++;
+		} else if (sdr1->indices[a] < sdr2->indices[b]) {
+			a++;
+		} else {
+			b++;
+		}
+	}
+	return overlap;
+}
+
+//returns a new sparse SDR that is the union of input sparse SDRs
+
+SparseSDR* sparse_union(SparseSDR* sdr1, SparseSDR* sdr2) {
+	SparseSDR* sdr = new_sparse_sdr(sdr1->len >= sdr2->len ? sdr1->len : sdr2->len, sdr1->count + sdr2->count);
+	int a = 0;
+	int b = 0;
+	while (a < sdr1->count || b < sdr2->count) { //merge both sorted index arrays, skipping duplicates
+		if (b == sdr2->count || (a < sdr1->count && sdr1->indices[a] < sdr2->indices[b])) {
+			sdr->indices[sdr->count++] = sdr1->indices[a++];
+		} else if (a == sdr1->count || sdr2->indices[b] < sdr1->indices[a]) {
+			sdr->indices[sdr->count++] = sdr2->indices[b++];
+		} else {
+			sdr->indices[sdr->count++] = sdr1->indices[a++];
+			b++;
+		}
+	}
+	return sdr;
+}
+
+//returns a new sparse SDR that is the concatenation of the input sparse SDRs
+
+SparseSDR* sparse_concat(SparseSDR* sdr1, SparseSDR* sdr2) {
+	SparseSDR* sdr = new_sparse_sdr(sdr1->len + sdr2->len, sdr1->count + sdr2->count);
+	int a;
+	for (a = 0; a < sdr1->count; a++) {
+		sdr->indices[a] = sdr1->indices[a];
+	}
+	for (a = 0; a < sdr2->count; a++) {
+		sdr->indices[a + sdr1->count] = sdr2->indices[a] + sdr1->len; //shift indices of the second SDR behind the first
+	}
+	sdr->count = sdr1->count + sdr2->count;
+	return sdr;
+}
+
+//returns a new packed SDR with the bits of the input sparse SDR set
+
+PackedSDR* sparse_to_packed(SparseSDR* sdr) {
+	PackedSDR* packed = new_packed_sdr(sdr->len);
+	int a;
+	for (a = 0; a < sdr->count; a++) {
+		packed_set(packed, sdr->indices[a]);
+	}
+	return packed;
+}
+
+//returns a new sparse SDR holding the set bits of the input packed SDR
+
+SparseSDR* packed_to_sparse(PackedSDR* packed) {
+	SparseSDR* sdr = new_sparse_sdr(packed->len, packed_count(packed));
+	int a;
+	for (a = 0; a < packed->word_count; a++) {
+		uint64_t word = packed->words[a];
+		while (word != 0) { //visit set bits only
+			sdr->indices[sdr->count++] = a * 64 + __builtin_ctzll(word);
+			word &= word - 1;
+		}
+	}
+	return sdr;
+}
+
+//overwrites the sparse SDR with the set bits of the packed SDR, the sparse SDR must have room for all of them
+
+void packed_fill_sparse(PackedSDR* packed, SparseSDR* sdr) {
+	sdr->count = 0;
+	int a;
+	for (a = 0; a < packed->word_count; a++) {
+		uint64_t word = packed->words[a];
+		while (word != 0) { //visit set bits only
+			sdr->indices[sdr->count++] = a * 64 + __builtin_ctzll(word);
+			word &= word - 1;
+		}
+	}
+}
+
+//returns a new SDR with the same bits as the input sparse SDR
+
+SDR* sparse_to_sdr(SparseSDR* sdr) {
+	char* bits = calloc(sdr->len, sizeof(char));
+	int a;
+	for (a = 0; a < sdr->count; a++) {
+		bits[sdr->indices[a]] = 1;
+	}
+	return bits_to_sdr(bits, sdr->len);
+}
 #endif // SDR_UTILS_H
@@ -3,6 +3,13 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "struct_utils.h"
 #include "sdr_utils.h"
 #include "cortex.h"
@@ -12,6 +19,215 @@
 //http://numenta.com/assets/pdf/whitepapers/hierarchical-temporal-memory-cortical-learning-algorithm-0.2.1-en.pdf
 //http://numenta.com/assets/pdf/biological-and-machine-intelligence/0.4/BaMI-Spatial-Pooler.pdf
 
+//sets or clears the bit of input connection "index" in the column's connected bitmap according to its permanence
+
+void spatial_update_connected(Column* column, int index) {
+	int bit = column->input_bits[index];
+	if (column->input_perms[index] >= INPUT_PERM_THRESHOLD) {
+		column->connected[bit >> 6] |= ((uint64_t) 1) << (bit & 63);
+	} else {
+		column->connected[bit >> 6] &= ~(((uint64_t) 1) << (bit & 63));
+	}
+}
+
+//updates the connected bitmap for the input connections "from" + (i >> shift) whose bit i is set in "crossed"
+
+void spatial_update_crossed(Column* column, int from, unsigned int crossed, int shift) {
+	while (crossed != 0) {
+		spatial_update_connected(column, from + (__builtin_ctz(crossed) >> shift));
+		crossed &= crossed - 1;
+	}
+}
+
+//vector operations on fixed point permanences, one byte (8 bit) or two bytes (16 bit) per lane
+//PERM_LANE_MASK keeps one bit per lane of a byte mask, PERM_LANE_SHIFT converts a bit of the byte mask to a lane
+
+#if PERMANENCE_BITS == 8
+#define PERM_LANE_MASK 0xFFFFFFFFu
+#define PERM_LANE_SHIFT 0
+#if defined(__AVX2__)
+#define PERM_LANES 32
+#define perm_vec_set1(x) _mm256_set1_epi8((char) (x))
+#define perm_vec_adds(x, y) _mm256_adds_epu8(x, y)
+#define perm_vec_subs(x, y) _mm256_subs_epu8(x, y)
+#define perm_vec_cmpeq(x, y) _mm256_cmpeq_epi8(x, y)
+#define perm_vec_flags(p) _mm256_loadu_si256((__m256i*) (p))
+#elif defined(__SSE2__)
+#define PERM_LANES 16
+#define perm_vec_set1(x) _mm_set1_epi8((char) (x))
+#define perm_vec_adds(x, y) _mm_adds_epu8(x, y)
+#define perm_vec_subs(x, y) _mm_subs_epu8(x, y)
+#define perm_vec_cmpeq(x, y) _mm_cmpeq_epi8(x, y)
+#define perm_vec_flags(p) _mm_loadu_si128((__m128i*) (p))
+#endif
+#elif PERMANENCE_BITS == 16
+#define PERM_LANE_MASK 0x55555555u
+#define PERM_LANE_SHIFT 1
+#if defined(__AVX2__)
+#define PERM_LANES 16
+#define perm_vec_set1(x) _mm256_set1_epi16((short) (x))
+#define perm_vec_adds(x, y) _mm256_adds_epu16(x, y)
+#define perm_vec_subs(x, y) _mm256_subs_epu16(x, y)
+#define perm_vec_cmpeq(x, y) _mm256_cmpeq_epi16(x, y)
+#define perm_vec_flags(p) _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) (p)))
+#elif defined(__SSE2__)
+#define PERM_LANES 8
+#define perm_vec_set1(x) _mm_set1_epi16((short) (x))
+#define perm_vec_adds(x, y) _mm_adds_epu16(x, y)
+#define perm_vec_subs(x, y) _mm_subs_epu16(x, y)
+#define perm_vec_cmpeq(x, y) _mm_cmpeq_epi16(x, y)
+#define perm_vec_flags(p) _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*) (p)), _mm_setzero_si128())
+#endif
+#endif
+#if defined(__AVX2__)
+#define perm_vec __m256i
+#define perm_vec_load(p) _mm256_loadu_si256((__m256i*) (p))
+#define perm_vec_store(p, x) _mm256_storeu_si256((__m256i*) (p), x)
+#define perm_vec_select(mask, x, y) _mm256_blendv_epi8(y, x, mask)
+#define perm_vec_xor(x, y) _mm256_xor_si256(x, y)
+#define perm_vec_zero() _mm256_setzero_si256()
+#define perm_vec_movemask(x) ((unsigned int) _mm256_movemask_epi8(x))
+#elif defined(__SSE2__)
+#define perm_vec __m128i
+#define perm_vec_load(p) _mm_loadu_si128((__m128i*) (p))
+#define perm_vec_store(p, x) _mm_storeu_si128((__m128i*) (p), x)
+#define perm_vec_select(mask, x, y) _mm_or_si128(_mm_and_si128(mask, x), _mm_andnot_si128(mask, y))
+#define perm_vec_xor(x, y) _mm_xor_si128(x, y)
+#define perm_vec_zero() _mm_setzero_si128()
+#define perm_vec_movemask(x) ((unsigned int) _mm_movemask_epi8(x))
+#endif
+
+//adds "inc" to the permanences of the active input connections (of all input connections if "all" is set), subtracts "dec" from the others
+//permanences are clamped to [0, 1], the connected bitmap is only touched for permanences crossing the threshold
+
+void spatial_adapt_perms(Column* column, perm_t inc, perm_t dec, char all) {
+	perm_t* perms = column->input_perms;
+	int a = 0;
+#if PERMANENCE_BITS != 0 && defined(PERM_LANES)
+	perm_vec vinc = perm_vec_set1(inc);
+	perm_vec vdec = perm_vec_set1(dec);
+	perm_vec threshold = perm_vec_set1(INPUT_PERM_THRESHOLD);
+	for (; a + PERM_LANES <= INPUT_COUNT; a += PERM_LANES) {
+		perm_vec old = perm_vec_load(perms + a);
+		perm_vec perm = perm_vec_adds(old, vinc);
+		if (!all) { //select the decreased permanence for the inactive input connections
+			perm_vec inactive = perm_vec_cmpeq(perm_vec_flags(column->input_active + a), perm_vec_zero());
+			perm = perm_vec_select(inactive, perm_vec_subs(old, vdec), perm);
+		}
+		perm_vec_store(perms + a, perm);
+		perm_vec crossed = perm_vec_xor(perm_vec_cmpeq(perm_vec_subs(threshold, old), perm_vec_zero()),
+				perm_vec_cmpeq(perm_vec_subs(threshold, perm), perm_vec_zero())); //x >= threshold if threshold - x saturates to 0
+		spatial_update_crossed(column, a, perm_vec_movemask(crossed) & PERM_LANE_MASK, PERM_LANE_SHIFT);
+	}
+#elif PERMANENCE_BITS == 0 && defined(__AVX2__)
+	__m256d vinc = _mm256_set1_pd(inc);
+	__m256d vdec = _mm256_set1_pd(-dec);
+	__m256d zero = _mm256_setzero_pd();
+	__m256d one = _mm256_set1_pd(1.0);
+	__m256d threshold = _mm256_set1_pd(INPUT_PERM_THRESHOLD);
+	for (; a + 4 <= INPUT_COUNT; a += 4) {
+		__m256d delta = vinc;
+		if (!all) { //select inc or -dec per lane from the active flags
+			int active;
+			memcpy(&active, column->input_active + a, sizeof(int));
+			__m256i inactive = _mm256_cmpeq_epi64(_mm256_cvtepi8_epi64(_mm_cvtsi32_si128(active)), _mm256_setzero_si256());
+			delta = _mm256_blendv_pd(vinc, vdec, _mm256_castsi256_pd(inactive));
+		}
+		__m256d old = _mm256_loadu_pd(perms + a);
+		__m256d perm = _mm256_min_pd(_mm256_max_pd(_mm256_add_pd(old, delta), zero), one);
+		_mm256_storeu_pd(perms + a, perm);
+		__m256d crossed = _mm256_xor_pd(_mm256_cmp_pd(old, threshold, _CMP_GE_OQ), _mm256_cmp_pd(perm, threshold, _CMP_GE_OQ));
+		spatial_update_crossed(column, a, _mm256_movemask_pd(crossed), 0);
+	}
+#elif PERMANENCE_BITS == 0 && defined(__SSE2__)
+	__m128d vinc = _mm_set1_pd(inc);
+	__m128d vdec = _mm_set1_pd(-dec);
+	__m128d zero = _mm_setzero_pd();
+	__m128d one = _mm_set1_pd(1.0);
+	__m128d threshold = _mm_set1_pd(INPUT_PERM_THRESHOLD);
+	for (; a + 2 <= INPUT_COUNT; a += 2) {
+		__m128d delta = vinc;
+		if (!all) { //select inc or -dec per lane from the active flags
+			__m128i inactive = _mm_cmpeq_epi32(_mm_set_epi64x(column->input_active[a + 1], column->input_active[a]), _mm_setzero_si128());
+			__m128d mask = _mm_castsi128_pd(_mm_shuffle_epi32(inactive, _MM_SHUFFLE(2, 2, 0, 0))); //low half decides the whole lane
+			delta = _mm_or_pd(_mm_and_pd(mask, vdec), _mm_andnot_pd(mask, vinc));
+		}
+		__m128d old = _mm_loadu_pd(perms + a);
+		__m128d perm = _mm_min_pd(_mm_max_pd(_mm_add_pd(old, delta), zero), one);
+		_mm_storeu_pd(perms + a, perm);
+		__m128d crossed = _mm_xor_pd(_mm_cmpge_pd(old, threshold), _mm_cmpge_pd(perm, threshold));
+		spatial_update_crossed(column, a, _mm_movemask_pd(crossed), 0);
+	}
+#endif
+	for (; a < INPUT_COUNT; a++) { //scalar fallback and remainder
+		perm_t old = perms[a];
+		perms[a] = all || column->input_active[a] ? perm_add(old, inc) : perm_sub(old, dec);
+		if ((old >= INPUT_PERM_THRESHOLD) != (perms[a] >= INPUT_PERM_THRESHOLD)) {
+			spatial_update_connected(column, a);
+		}
+	}
+}
+
+//rebuilds the connected bitmap of a column from the permanences of its input connections
+
+void spatial_connect_column(Column* column, int input_len) {
+	free(column->connected);
+	column->connected = calloc((input_len + 63) / 64, sizeof(uint64_t));
+	int a;
+	for (a = 0; a < INPUT_COUNT; a++) {
+		spatial_update_connected(column, a);
+	}
+}
+
+//rebuilds the connected bitmaps of all columns
+
+void spatial_connect_region(Region* region) {
+	int a;
+	for (a = 0; a < COLUMN_COUNT; a++) {
+		spatial_connect_column(&(region->columns[a]), region->input_len);
+	}
+}
+
+//returns the initial permanence of an input connection to input bit "bit", connections closer to the column's center start higher
+
+double spatial_initial_perm(Column* column, int bit, int input_len) {
+	int sign = rand() % 2 == 0 ? 1 : -1;
+	double dif = sign * (rand() % 100 + 1) / 1000.0;
+	int distance = column->center_index - bit;
+	distance = distance >= 0 ? distance : -distance;
+	double bias = 0.1 - 0.1 * distance / ((double) input_len);
+	return INPUT_PERMANENCE_THRESHOLD - 0.15 + dif + bias;
+}
+
+//samples the input bits of a column in ascending order, the receptive field is split into INPUT_COUNT equally sized strata and one random bit is picked from each
+//a receptive field narrower than INPUT_COUNT bits is widened around the column's center, the connected bitmap holds one bit per input bit
+//bits only repeat if the whole input is smaller than INPUT_COUNT, like in the unsorted pool
+
+void spatial_sample_column(Column* column, int input_len) {
+	int low = 0; //first bit of the receptive field
+	int size = input_len; //number of bits in the receptive field
+	if (INPUT_RECEPTIVE_FIELD > 0) {
+		low = column->center_index - INPUT_RECEPTIVE_FIELD > 0 ? column->center_index - INPUT_RECEPTIVE_FIELD : 0;
+		int high = column->center_index + INPUT_RECEPTIVE_FIELD < input_len ? column->center_index + INPUT_RECEPTIVE_FIELD : input_len - 1;
+		size = high - low + 1;
+		if (size < INPUT_COUNT && input_len >= INPUT_COUNT) { //widen the field to INPUT_COUNT bits, shifted to stay inside the input
+			size = INPUT_COUNT;
+			low = column->center_index - size / 2 > 0 ? column->center_index - size / 2 : 0;
+			low = low + size <= input_len ? low : input_len - size;
+		}
+	}
+	int a;
+	for (a = 0; a < INPUT_COUNT; a++) {
+		long first = (long) a * size / INPUT_COUNT; //first bit of the stratum relative to "low"
+		long width = (long) (a + 1) * size / INPUT_COUNT - first;
+		if (width == 0) { //field smaller than INPUT_COUNT, stratum is empty
+			column->input_bits[a] = low + (first < size ? first : size - 1);
+		} else {
+			column->input_bits[a] = low + first + rand() % width;
+		}
+	}
+}
+
 //initializes a column, requires the length of the input SDRs to initialize the input connections
 
 void spatial_init_column(Column* column, int input_len) {
@@ -19,15 +235,23 @@ void spatial_init_column(Column* column, int input_len) {
 	column->center_index = rand() % input_len; //pick a random index as the column's center
 	column->average_active = 0;
 	column->average_overlap = 0;
-	char* used = malloc(input_len * sizeof(char)); //array for remembering to which indices an input connection has already been created
+	column->average_cycle = -1;
 	int a;
+	if (INPUT_SORTED_POOL) {
+		spatial_sample_column(column, input_len);
+		for (a = 0; a < INPUT_COUNT; a++) {
+			column->input_perms[a] = perm_quantize(spatial_initial_perm(column, column->input_bits[a], input_len));
+		}
+		spatial_connect_column(column, input_len);
+		return;
+	}
+	char* used = malloc(input_len * sizeof(char)); //array for remembering to which indices an input connection has already been created
 	for (a = 0; a < input_len; a++) {
 		used[a] = 0;
 	}
 	int count = input_len; //number of available distinct indices
 	int rest = INPUT_COUNT; //number of input connections still to be created
 	for (a = 0; a < INPUT_COUNT; a++) {
-		Input* input = &(column->inputs[a]);
 		int i = -1;
 		while (count > 0 && rest > 0) { //do as long as new input connections to be created are left AND there are still unused indices left
 			i = rand() % input_len; //pick a random index
@@ -38,85 +262,179 @@ void spatial_init_column(Column* column, int input_len) {
 				break;
 			}
 		}
-		input->bit_index = i != -1 ? i : rand() % input_len; //if no unused index was found use a random index instead
-		//following code calculates the initial permanence for the input connection
-		int sign = rand() % 2 == 0 ? 1 : -1;
-		double dif = sign * (rand() % 100 + 1) / 1000.0;
-		int distance = column->center_index - input->bit_index;
-		distance = distance >= 0 ? distance : -distance;
-		double bias = 0.1 - 0.1 * distance / ((double) input_len);
-		input->perm = INPUT_PERMANENCE_THRESHOLD - 0.15 + dif + bias;
-		input->perm = input->perm < 0.0 ? 0.0 : input->perm;
-		input->perm = input->perm > 1.0 ? 1.0 : input->perm;
+		column->input_bits[a] = i != -1 ? i : rand() % input_len; //if no unused index was found use a random index instead
+		column->input_perms[a] = perm_quantize(spatial_initial_perm(column, column->input_bits[a], input_len));
 	}
 	free(used);
+	spatial_connect_column(column, input_len);
+}
+
+//builds the inverted index from input bits to the input connections sampling them
+
+void spatial_index_region(Region* region) {
+	if (!INPUT_INVERTED_INDEX) {
+		return;
+	}
+	free(region->input_index_offsets);
+	free(region->input_index);
+	region->input_index_offsets = calloc(region->input_len + 1, sizeof(int));
+	region->input_index = malloc(COLUMN_COUNT * INPUT_COUNT * sizeof(int));
+	int a;
+	int b;
+	for (a = 0; a < COLUMN_COUNT; a++) { //count the input connections per bit
+		for (b = 0; b < INPUT_COUNT; b++) {
+			region->input_index_offsets[region->columns[a].input_bits[b] + 1]++;
+		}
+	}
+	for (a = 0; a < region->input_len; a++) { //turn counts into offsets
+		region->input_index_offsets[a + 1] += region->input_index_offsets[a];
+	}
+	int* next = malloc(region->input_len * sizeof(int)); //next free entry per bit
+	for (a = 0; a < region->input_len; a++) {
+		next[a] = region->input_index_offsets[a];
+	}
+	for (a = 0; a < COLUMN_COUNT; a++) { //fill in column order, so the entries of each bit are sorted by column
+		for (b = 0; b < INPUT_COUNT; b++) {
+			region->input_index[next[region->columns[a].input_bits[b]]++] = a * INPUT_COUNT + b;
+		}
+	}
+	free(next);
 }
 
 //initializes the region
 
 void spatial_init_region(Region* region, int input_len) {
 	region->cycle = 0;
+	region->input_len = input_len;
+	region->average_max = 0;
+	region->average_max_column = -1;
+	region->overlap_histogram = calloc(INPUT_COUNT * (COLUMN_MAX_BOOST > 1 ? COLUMN_MAX_BOOST : 1) + 1, sizeof(int)); //overlap never exceeds INPUT_COUNT * COLUMN_MAX_BOOST
 	int a;
 	for (a = 0; a < COLUMN_COUNT; a++) {
 		Column* column = &(region->columns[a]);
 		spatial_init_column(column, input_len);
 	}
+	spatial_index_region(region);
+	for (a = 0; a < region->job_count; a++) {
+		region->jobs[a].histogram = calloc(INPUT_COUNT * (COLUMN_MAX_BOOST > 1 ? COLUMN_MAX_BOOST : 1) + 1, sizeof(int));
+	}
+}
+
+//returns the moving average window used in a cycle, the window grows with the cycle until it reaches COLUMN_AVERAGE_WINDOW
+
+int spatial_average_window(long cycle) {
+	long window = cycle <= COLUMN_AVERAGE_WINDOW ? cycle : COLUMN_AVERAGE_WINDOW;
+	return window >= 1 ? window : 1; //at least 1, a window of 0 in cycle 0 would turn every average into NaN
+}
+
+//returns the factor by which a moving average decays between cycle "from" and cycle "to" without activity
+//every cycle c multiplies it by 1 - 1 / window(c), which telescopes to from / to while the window still grows
+
+double spatial_average_decay(long from, long to) {
+	if (to <= from) {
+		return 1.0;
+	}
+	int window = spatial_average_window(to);
+	if (from < 1 || window == 1) { //cycles with window 1 reset the average
+		return 0.0;
+	}
+	double decay = 1.0;
+	if (from < window) { //cycles from + 1 to min(to, window) with growing window
+		decay = from / (double) (to < window ? to : window);
+	}
+	if (to > window) { //cycles with full window
+		decay *= pow(1.0 - 1.0 / window, to - (from > window ? from : window));
+	}
+	return decay;
+}
+
+//brings the moving averages of the column to "cycle" and counts the column's activity and overlap in this cycle
+//the averages are only updated when the column is active or has overlap, in between they decay lazily
+
+void spatial_column_averages(Column* column, long cycle, char active, char overlap) {
+	double decay = spatial_average_decay(column->average_cycle, cycle);
+	int window = spatial_average_window(cycle);
+	column->average_active = column->average_active * decay + (active ? 1.0 / window : 0.0);
+	column->average_overlap = column->average_overlap * decay + (overlap ? 1.0 / window : 0.0);
+	column->average_cycle = cycle;
 }
 
-//finds the max average activation rate of all columns
+//returns the average activation rate of the column in "cycle"
+
+double spatial_average_active(Column* column, long cycle) {
+	return column->average_active * spatial_average_decay(column->average_cycle, cycle);
+}
+
+//returns the average overlap rate of the column in "cycle"
+
+double spatial_average_overlap(Column* column, long cycle) {
+	return column->average_overlap * spatial_average_decay(column->average_cycle, cycle);
+}
+
+//finds the max average activation rate of all columns, all averages decay at the same rate, so the column with the max only changes when another column is active
 
 double spatial_max_activity(Region* region) {
+	if (region->average_max_column == -1) {
+		return 0;
+	}
+	return spatial_average_active(&(region->columns[region->average_max_column]), region->cycle);
+}
+
+//searches all columns for the one with the max average activation rate, required after loading
+
+void spatial_find_max_activity(Region* region) {
 	double max = 0;
+	region->average_max_column = -1;
 	int a;
 	for (a = 0; a < COLUMN_COUNT; a++) {
-		Column* column = &(region->columns[a]);
-		if (column->average_active > max) {
-			max = column->average_active;
+		double average = spatial_average_active(&(region->columns[a]), region->cycle);
+		if (average > max) {
+			max = average;
+			region->average_max_column = a;
 		}
 	}
-	return max;
 }
 
-//computes the average activation rate for a column, uses a moving average approximation
+//computes the average activation rate for the "count" active columns with the indices in "columns"
+//returns the index of the first column exceeding "max" with the highest average and stores that average in "max", returns -1 if none exceeds it
 
-void spatial_column_averages(Column* column, int window) {
-	column->average_active -= column->average_active / window;
-	if (column->active) {
-		column->average_active += 1.0 / window;
-	}
-	column->average_overlap -= column->average_overlap / window;
-	if (column->overlap > 0) {
-		column->average_overlap += 1.0 / window;
+int spatial_average_columns(Region* region, int* columns, int count, double* max) {
+	int max_column = -1;
+	int a;
+	for (a = 0; a < count; a++) {
+		Column* column = &(region->columns[columns[a]]);
+		spatial_column_averages(column, region->cycle, 1, 0);
+		if (column->average_active > *max) {
+			*max = column->average_active;
+			max_column = columns[a];
+		}
 	}
+	return max_column;
 }
 
-//computes the average activation rate for each column and sets the max average activation rate
+//computes the average activation rate for the winning columns and sets the max average activation rate
+//overlap is already counted when the overlap is computed
 
 void spatial_region_averages(Region* region) {
-	int a;
-	int window = region->cycle <= COLUMN_AVERAGE_WINDOW ? region->cycle : COLUMN_AVERAGE_WINDOW;
-	for (a = 0; a < COLUMN_COUNT; a++) {
-		Column* column = &(region->columns[a]);
-		spatial_column_averages(column, window);
+	double max = spatial_max_activity(region);
+	int max_column = spatial_average_columns(region, region->active_columns, region->active_column_count, &max);
+	if (max_column != -1) {
+		region->average_max_column = max_column;
 	}
-	region->average_max = spatial_max_activity(region);
+	region->average_max = max;
 }
 
 //boosts a column if necessary
 
-void spatial_boost_column(Column* column, double max) {
-	if (column->average_active < 0.01 * max) { //if boosting is required
+void spatial_boost_column(Column* column, double max, long cycle) {
+	double decay = spatial_average_decay(column->average_cycle, cycle);
+	if (column->average_active * decay < 0.01 * max) { //if boosting is required
 		column->boost = column->boost < COLUMN_MAX_BOOST ? column->boost + 1 : COLUMN_MAX_BOOST; //increment boost value if maximum value not yet reached
 	} else {
 		column->boost = 1; //reset boost value to 1
 	}
-	if (column->average_overlap < 0.01 * max) { //if column's overlap is too low
-		int b;
-		for (b = 0; b < INPUT_COUNT; b++) { //increase permanences of all input connections
-			Input* input = &(column->inputs[b]);
-			input->perm += 0.1 * INPUT_PERMANENCE_THRESHOLD;
-			input->perm = input->perm > 1.0 ? 1.0 : input->perm;
-		}
+	if (column->average_overlap * decay < 0.01 * max) { //if column's overlap is too low
+		spatial_adapt_perms(column, INPUT_PERM_BOOST, 0, 1); //increase permanences of all input connections
 	}
 }
 
@@ -128,7 +446,7 @@ void spatial_boost_region(Region* region, int from, int to) {
 		double max = region->average_max;
 		for (a = from; a <= to; a++) {
 			Column* column = &(region->columns[a]);
-			spatial_boost_column(column, max);
+			spatial_boost_column(column, max, region->cycle);
 		}
 	}
 }
@@ -136,105 +454,270 @@ void spatial_boost_region(Region* region, int from, int to) {
 //resets the winning columns
 
 void spatial_reset_region(Region* region) {
-	free_list(region->active_columns);
-	region->active_columns = NULL;
+	region->active_column_count = 0;
 }
 
-//reinforces a column
+//marks the input connections of the column active for the input SDR, returns the number of active input connections
 
-void spatial_reinforce_column(Column* column) {
+int spatial_column_activity(Column* column, PackedSDR* sdr) {
+	int overlap = 0;
 	int a;
 	for (a = 0; a < INPUT_COUNT; a++) {
-		Input* input = &(column->inputs[a]);
-		if (input->active) { //if input connection is active: positive reinforcement
-			input->perm += INPUT_PERMANENCE_INC;
-			input->perm = input->perm > 1.0 ? 1.0 : input->perm;
-		} else { //otherwise negative reinforcement
-			input->perm -= INPUT_PERMANENCE_DEC;
-			input->perm = input->perm < 0.0 ? 0.0 : input->perm;
+		if (INPUT_PERMANENCE_CHECK) { //if permanence check is enabled
+			if (column->input_perms[a] >= INPUT_PERM_THRESHOLD && packed_is_set(sdr, column->input_bits[a])) { //if permanence threshold is reached and SDR bit is set
+				column->input_active[a] = 1;
+			} else {
+				column->input_active[a] = 0;
+			}
+		} else {
+			if (packed_is_set(sdr, column->input_bits[a])) { //if SDR bit is set
+				column->input_active[a] = 1;
+			} else {
+				column->input_active[a] = 0;
+			}
 		}
+		overlap += column->input_active[a];
+	}
+	return overlap;
+}
+
+//reinforces a column, active input connections positively, inactive ones negatively
+
+void spatial_reinforce_column(Column* column) {
+	spatial_adapt_perms(column, INPUT_PERM_INC, INPUT_PERM_DEC, 0);
+}
+
+//reinforces the "count" columns with the indices in "columns"
+
+void spatial_reinforce_columns(Region* region, int* columns, int count) {
+	int a;
+	for (a = 0; a < count; a++) {
+		Column* column = &(region->columns[columns[a]]);
+		if (INPUT_INVERTED_INDEX || INPUT_PERMANENCE_CHECK) { //indexed and bitmap overlap do not mark the input connections
+			spatial_column_activity(column, region->sdr);
+		}
+		spatial_reinforce_column(column);
 	}
 }
 
 //reinforces the winning columns
 
 void spatial_reinforce_region(Region* region) {
-	List* active_columns = region->active_columns;
-	while (active_columns != NULL) {
-		Column* column = &(region->columns[active_columns->elem]);
-		spatial_reinforce_column(column);
-		active_columns = active_columns->next;
+	spatial_reinforce_columns(region, region->active_columns, region->active_column_count);
+}
+
+//finds the overlap threshold a column must exceed to win from the histogram of overlap values between 0 and max
+//the lowest overlap value only counts if more than one column has it
+//clears the histogram
+
+int spatial_histogram_threshold(int* histogram, int max) {
+	int min = 0;
+	while (histogram[min] == 0 && min < max) { //find the lowest overlap value
+		min++;
+	}
+	histogram[min]--;
+	int val = max; //highest overlap value
+	int i = 1; //i-th highest overlap value
+	int a;
+	for (a = max - 1; a >= 0 && i < REGION_ACTIVE_COLUMNS; a--) { //find the i-th highest overlap value required by REGION_ACTIVE_COLUMNS
+		if (histogram[a] > 0) {
+			val = a;
+			i++;
+		}
+	}
+	for (a = 0; a <= max; a++) {
+		histogram[a] = 0;
+	}
+	return val;
+}
+
+//counts the columns between index "from" and "to" per overlap value in the histogram, returns the max overlap
+
+int spatial_overlap_histogram(Region* region, int* histogram, int from, int to) {
+	int max = 0;
+	int a;
+	for (a = from; a <= to; a++) {
+		Column* column = &(region->columns[a]);
+		histogram[column->overlap]++;
+		max = column->overlap > max ? column->overlap : max;
 	}
+	return max;
 }
 
 //finds the overlap threshold a column must exceed to win
 
 int spatial_activation_threshold(Region* region) {
-	int* overlaps = malloc(COLUMN_COUNT * sizeof(int)); //array with overlap values of all columns
+	int max = spatial_overlap_histogram(region, region->overlap_histogram, 0, COLUMN_COUNT - 1);
+	return spatial_histogram_threshold(region->overlap_histogram, max);
+}
+
+//activates the columns between index "from" and "to" reaching the overlap threshold "val", stores their indices ascending in "winners" and returns their number
+
+int spatial_select_columns(Region* region, int val, int* winners, int from, int to) {
+	int count = 0;
 	int a;
-	for (a = 0; a < COLUMN_COUNT; a++) { //fill array with overlap values
+	for (a = from; a <= to; a++) {
 		Column* column = &(region->columns[a]);
-		overlaps[a] = column->overlap;
-	}
-	qsort(overlaps, COLUMN_COUNT, sizeof(int), comp_ints); //sort array by overlap value
-	int val = overlaps[COLUMN_COUNT - 1]; //highest overlap value
-	int i = 1; //i-th highest overlap value
-	for (a = COLUMN_COUNT - 2; a > 0 && i < REGION_ACTIVE_COLUMNS; a--) { //find the i-th highest overlap value required by REGION_ACTIVE_COLUMNS
-		if (overlaps[a] != val) {
-			val = overlaps[a];
-			i++;
+		column->active = column->overlap > 0 && column->overlap >= val ? 1 : 0;
+		if (column->active) {
+			winners[count++] = a;
 		}
 	}
-	free(overlaps);
-	return val;
+	return count;
 }
 
 //activates the winning columns
 
 void spatial_activate_region(Region* region) {
 	int val = spatial_activation_threshold(region); //overlap threshold to be reached for column activation
+	region->active_column_count = spatial_select_columns(region, val, region->active_columns, 0, COLUMN_COUNT - 1);
+}
+
+//counts the overlaps of the columns between index "from" and "to" in the histogram of job "job"
+
+void spatial_histogram_job(Region* region, int from, int to, int job) {
+	region->jobs[job].max_overlap = spatial_overlap_histogram(region, region->jobs[job].histogram, from, to);
+}
+
+//merges the histograms of the jobs and sets the overlap threshold for spatial_activate_job()
+//clears the histograms of the jobs
+
+void spatial_merge_histograms(Region* region) {
+	int max = 0;
 	int a;
-	for (a = 0; a < COLUMN_COUNT; a++) { //find the winning columns
-		Column* column = &(region->columns[a]);
-		column->active = column->overlap > 0 && column->overlap >= val ? 1 : 0;
-		if (column->active) {
-			region->active_columns = add_elem(a, region->active_columns);
+	for (a = 0; a < region->job_count; a++) {
+		max = region->jobs[a].max_overlap > max ? region->jobs[a].max_overlap : max;
+	}
+	int b;
+	for (a = 0; a < region->job_count; a++) {
+		int* histogram = region->jobs[a].histogram;
+		for (b = 0; b <= region->jobs[a].max_overlap; b++) {
+			region->overlap_histogram[b] += histogram[b];
+			histogram[b] = 0;
 		}
 	}
+	region->overlap_threshold = spatial_histogram_threshold(region->overlap_histogram, max);
+	region->average_max = spatial_max_activity(region); //max average before this cycle, compared against by the jobs
+}
+
+//activates the winning columns between index "from" and "to", reinforces them and updates their averages if learning is enabled
+//the winners are stored in active_columns starting at index "from" until spatial_merge_winners() compacts them
+
+void spatial_activate_job(Region* region, int from, int to, int job) {
+	RegionJob* region_job = &(region->jobs[job]);
+	int* winners = region->active_columns + from;
+	region_job->from = from;
+	region_job->winner_count = spatial_select_columns(region, region->overlap_threshold, winners, from, to);
+	region_job->average_max = region->average_max;
+	region_job->average_max_column = -1;
+	if (ENABLE_LEARNING) {
+		spatial_reinforce_columns(region, winners, region_job->winner_count);
+		region_job->average_max_column = spatial_average_columns(region, winners, region_job->winner_count,
+				&(region_job->average_max));
+	}
+}
+
+//merges the winners and max averages of the jobs in the order of their columns, so the result does not depend on the thread count
+
+void spatial_merge_winners(Region* region) {
+	region->active_column_count = 0;
+	int a;
+	for (a = 0; a < region->job_count; a++) {
+		RegionJob* region_job = &(region->jobs[a]);
+		if (region_job->winner_count > 0) { //winners of earlier jobs never overlap the slice of a later job
+			memmove(region->active_columns + region->active_column_count, region->active_columns + region_job->from,
+					region_job->winner_count * sizeof(int));
+			region->active_column_count += region_job->winner_count;
+		}
+		if (region_job->average_max_column != -1 && region_job->average_max > region->average_max) {
+			region->average_max = region_job->average_max;
+			region->average_max_column = region_job->average_max_column;
+		}
+	}
+}
+
+//sets the overlap of the column from the number of its active input connections
+
+void spatial_set_overlap(Column* column, int overlap) {
+	column->overlap = overlap >= COLUMN_STIMULUS_THRESHOLD ? overlap * column->boost : 0; //if overlap * boost does not reach stimulus threshold, set overlap to 0
 }
 
 //computes the overlap of the column and the input SDR
 
-void spatial_column_overlap(Column* column, SDR* sdr) {
+void spatial_column_overlap(Column* column, PackedSDR* sdr) {
+	spatial_set_overlap(column, spatial_column_activity(column, sdr));
+}
+
+//computes the overlap of the column and the input SDR from the column's connected bitmap
+
+void spatial_column_connected_overlap(Column* column, PackedSDR* sdr, int input_len) {
 	int overlap = 0;
 	int a;
-	for (a = 0; a < INPUT_COUNT; a++) {
-		Input* input = &(column->inputs[a]);
-		if (INPUT_PERMANENCE_CHECK) { //if permanence check is enabled
-			if (input->perm >= INPUT_PERMANENCE_THRESHOLD && is_set(sdr, input->bit_index)) { //if permanence threshold is reached and SDR bit is set
-				input->active = 1;
+	for (a = 0; a < (input_len + 63) / 64 && a < sdr->word_count; a++) {
+		overlap += __builtin_popcountll(column->connected[a] & sdr->words[a]);
+	}
+	spatial_set_overlap(column, overlap);
+}
+
+//computes the overlaps of the columns between index "from" and "to" by visiting only the input connections sampling set bits
+
+void spatial_give_input_indexed(Region* region, int from, int to) {
+	int a;
+	for (a = from; a <= to; a++) {
+		region->columns[a].overlap = 0; //used as counter of active input connections
+	}
+	SparseSDR* sdr = region->sparse_sdr;
+	int first = from * INPUT_COUNT; //lowest entry belonging to the columns
+	int last = to * INPUT_COUNT + INPUT_COUNT - 1; //highest entry belonging to the columns
+	for (a = 0; a < sdr->count && sdr->indices[a] < region->input_len; a++) {
+		uint64_t mask = ((uint64_t) 1) << (sdr->indices[a] & 63); //position of the bit in the connected bitmaps
+		int low = region->input_index_offsets[sdr->indices[a]];
+		int high = region->input_index_offsets[sdr->indices[a] + 1];
+		while (low < high) { //binary search for the first entry of the columns
+			int mid = (low + high) / 2;
+			if (region->input_index[mid] < first) {
+				low = mid + 1;
 			} else {
-				input->active = 0;
+				high = mid;
 			}
-		} else {
-			if (is_set(sdr, input->bit_index)) { //if SDR bit is set
-				input->active = 1;
-			} else {
-				input->active = 0;
+		}
+		int b;
+		for (b = low; b < region->input_index_offsets[sdr->indices[a] + 1] && region->input_index[b] <= last; b++) {
+			Column* column = &(region->columns[region->input_index[b] / INPUT_COUNT]);
+			if (!INPUT_PERMANENCE_CHECK || (column->connected[sdr->indices[a] >> 6] & mask)) { //if permanence check is disabled or input connection is connected
+				column->overlap++;
 			}
 		}
-		overlap += input->active;
 	}
-	column->overlap = overlap >= COLUMN_STIMULUS_THRESHOLD ? overlap * column->boost : 0; //if overlap * boost does not reach stimulus threshold, set overlap to 0
+	for (a = from; a <= to; a++) {
+		Column* column = &(region->columns[a]);
+		spatial_set_overlap(column, column->overlap);
+	}
 }
 
 //gives the columns between index "from" and "to" the input SDR
 
 void spatial_give_input(Region* region, int from, int to) {
 	int a;
-	for (a = from; a <= to; a++) {
-		Column* column = &(region->columns[a]);
-		spatial_column_overlap(column, region->sdr);
+	if (INPUT_INVERTED_INDEX) {
+		spatial_give_input_indexed(region, from, to);
+	} else {
+		for (a = from; a <= to; a++) {
+			Column* column = &(region->columns[a]);
+			if (INPUT_PERMANENCE_CHECK) {
+				spatial_column_connected_overlap(column, region->sdr, region->input_len);
+			} else {
+				spatial_column_overlap(column, region->sdr);
+			}
+		}
+	}
+	if (ENABLE_LEARNING) {
+		for (a = from; a <= to; a++) { //count the overlap in the moving averages of the columns
+			Column* column = &(region->columns[a]);
+			if (column->overlap > 0) {
+				spatial_column_averages(column, region->cycle, 0, 1);
+			}
+		}
 	}
 }
 
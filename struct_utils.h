@@ -126,6 +126,169 @@ long list_size(List* list) {
 	return list->len * sizeof(List);
 }
 
+//fixed size object allocator, objects are carved from large blocks and recycled through a free list
+//a Slab must only be used by one thread at a time, objects may be freed to another Slab of the same size, blocks are released all at once
+
+#define SLAB_BLOCK_SIZE 65536
+
+typedef struct Slab {
+	size_t size; //object size
+	int per_block; //objects per block
+	void* free; //free list, the first word of a free object points to the next free object
+	char* block; //current block
+	int used; //objects carved from the current block
+	void** blocks;
+	int block_count;
+	int block_capacity;
+} Slab;
+
+//index of the calling thread's slabs, 0 for the main thread, threads of the thread pool use 1 to thread_count
+
+__thread int thread_slot = 0;
+
+//initializes a slab for objects of "size" bytes
+
+void init_slab(Slab* slab, size_t size) {
+	size = size < sizeof(void*) ? sizeof(void*) : size;
+	slab->size = (size + 7) & ~((size_t) 7); //keep objects 8 byte aligned
+	slab->per_block = SLAB_BLOCK_SIZE / slab->size > 0 ? SLAB_BLOCK_SIZE / slab->size : 1;
+	slab->free = NULL;
+	slab->block = NULL;
+	slab->used = slab->per_block;
+	slab->blocks = NULL;
+	slab->block_count = 0;
+	slab->block_capacity = 0;
+}
+
+//returns an object of the slab's size
+
+void* slab_alloc(Slab* slab) {
+	if (slab->free != NULL) { //reuse a freed object
+		void* object = slab->free;
+		slab->free = *(void**) object;
+		return object;
+	}
+	if (slab->used == slab->per_block) { //current block is full
+		if (slab->block_count == slab->block_capacity) {
+			slab->block_capacity = slab->block_capacity > 0 ? slab->block_capacity * 2 : 16;
+			slab->blocks = realloc(slab->blocks, slab->block_capacity * sizeof(void*));
+		}
+		slab->block = malloc(slab->per_block * slab->size);
+		slab->blocks[slab->block_count++] = slab->block;
+		slab->used = 0;
+	}
+	return slab->block + slab->size * slab->used++;
+}
+
+//returns an object to the slab's free list
+
+void slab_free(Slab* slab, void* object) {
+	if (object == NULL) {
+		return;
+	}
+	*(void**) object = slab->free;
+	slab->free = object;
+}
+
+//releases all blocks of the slab, invalidates all objects allocated from it
+
+void release_slab(Slab* slab) {
+	int a;
+	for (a = 0; a < slab->block_count; a++) {
+		free(slab->blocks[a]);
+	}
+	free(slab->blocks);
+	init_slab(slab, slab->size);
+}
+
+//an Arena hands out memory of any size by advancing through its blocks, objects are not freed individually
+//reset_arena() invalidates all objects at once and keeps the blocks for reuse, an Arena must only be used by one thread at a time
+
+#define ARENA_BLOCK_SIZE 65536
+
+typedef struct Arena {
+	char** blocks;
+	size_t* sizes; //bytes of each block, blocks are larger than ARENA_BLOCK_SIZE only for larger objects
+	int block_count;
+	int block_capacity;
+	int current; //block objects are carved from
+	size_t used; //bytes carved from the current block
+} Arena;
+
+//initializes an empty arena
+
+void init_arena(Arena* arena) {
+	arena->blocks = NULL;
+	arena->sizes = NULL;
+	arena->block_count = 0;
+	arena->block_capacity = 0;
+	arena->current = 0;
+	arena->used = 0;
+}
+
+//returns "size" bytes of the arena, 8 byte aligned
+
+void* arena_alloc(Arena* arena, size_t size) {
+	size = (size + 7) & ~((size_t) 7);
+	while (arena->current < arena->block_count && arena->used + size > arena->sizes[arena->current]) { //continue in the next block
+		arena->current++;
+		arena->used = 0;
+	}
+	if (arena->current == arena->block_count) { //all blocks are full
+		if (arena->block_count == arena->block_capacity) {
+			arena->block_capacity = arena->block_capacity > 0 ? arena->block_capacity * 2 : 16;
+			arena->blocks = realloc(arena->blocks, arena->block_capacity * sizeof(char*));
+			arena->sizes = realloc(arena->sizes, arena->block_capacity * sizeof(size_t));
+		}
+		arena->sizes[arena->block_count] = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+		arena->blocks[arena->block_count] = malloc(arena->sizes[arena->block_count]);
+		arena->block_count++;
+		arena->used = 0;
+	}
+	void* object = arena->blocks[arena->current] + arena->used;
+	arena->used += size;
+	return object;
+}
+
+//invalidates all objects allocated from the arena, the blocks are reused by later calls to arena_alloc()
+
+void reset_arena(Arena* arena) {
+	arena->current = 0;
+	arena->used = 0;
+}
+
+//releases all blocks of the arena
+
+void release_arena(Arena* arena) {
+	int a;
+	for (a = 0; a < arena->block_count; a++) {
+		free(arena->blocks[a]);
+	}
+	free(arena->blocks);
+	free(arena->sizes);
+	init_arena(arena);
+}
+
+//add_elem() with the new node allocated from "slab"
+
+List* add_slab_elem(long elem, List* list, Slab* slab) {
+	List* new_list = slab_alloc(slab);
+	new_list->elem = elem;
+	new_list->next = list;
+	new_list->len = list != NULL ? list->len + 1 : 1;
+	return new_list;
+}
+
+//free_list() for Lists allocated from "slab"
+
+void free_slab_list(List* list, Slab* slab) {
+	while (list != NULL) {
+		List* next = list->next;
+		slab_free(slab, list);
+		list = next;
+	}
+}
+
 //helper function to compare two integers
 
 int comp_ints(const void* a, const void* b) {
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "struct_utils.h"
 #include "cortex.h"
 
@@ -11,89 +12,660 @@
 //http://numenta.com/assets/pdf/whitepapers/hierarchical-temporal-memory-cortical-learning-algorithm-0.2.1-en.pdf
 //http://numenta.com/assets/pdf/biological-and-machine-intelligence/0.4/BaMI-Temporal-Memory.pdf
 
-//removes old and unused updates inside a column
+//makes room for "count" more synapses in the synapse arrays of the cell
 
-void temporal_column_forget_updates(Column* column, long cycle, long cycles) {
+void temporal_reserve_synapses(Cell* cell, int count) {
+	if (cell->synapse_count + count <= cell->synapse_capacity) {
+		return;
+	}
+	int capacity = cell->synapse_capacity > 0 ? cell->synapse_capacity * 2 : 16;
+	while (capacity < cell->synapse_count + count) {
+		capacity *= 2;
+	}
+	cell->synapse_cells = realloc(cell->synapse_cells, capacity * sizeof(int));
+	cell->synapse_perms = realloc(cell->synapse_perms, capacity * sizeof(perm_t));
+	cell->synapse_cycles = realloc(cell->synapse_cycles, capacity * sizeof(long));
+	cell->synapse_capacity = capacity;
+}
+
+//returns the position of the first target of the presynaptic cell belonging to a cell with index "cell" or higher
+
+int temporal_find_target(Cell* presynaptic, int cell) {
+	int low = 0;
+	int high = presynaptic->target_count;
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if (presynaptic->targets[mid].cell < cell) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+//inserts a target at "position" into the targets of the presynaptic cell
+
+void temporal_insert_target(Cell* presynaptic, int position, int cell, Segment* segment, char connected) {
+	if (presynaptic->target_count == presynaptic->target_capacity) {
+		presynaptic->target_capacity = presynaptic->target_capacity > 0 ? presynaptic->target_capacity * 2 : 4;
+		presynaptic->targets = realloc(presynaptic->targets, presynaptic->target_capacity * sizeof(SegmentRef));
+	}
+	memmove(presynaptic->targets + position + 1, presynaptic->targets + position,
+			(presynaptic->target_count - position) * sizeof(SegmentRef));
+	presynaptic->targets[position].cell = cell;
+	presynaptic->targets[position].connected = connected;
+	presynaptic->targets[position].segment = segment;
+	presynaptic->target_count++;
+}
+
+//returns the position of a target of the presynaptic cell for the segment of cell "cell" with the given connected flag, -1 if there is none
+
+int temporal_find_synapse_target(Cell* presynaptic, int cell, Segment* segment, char connected) {
 	int a;
-	for (a = 0; a < CELL_COUNT; a++) {
-		Cell* cell = &(column->cells[a]);
-		List* segment_updates = cell->segment_updates; //current list of updates
-		List* new_segment_updates = NULL; //new list of updates
-		while (segment_updates != NULL) {
-			Update* update = (Update*) segment_updates->elem;
-			if (cycle - update->active_cycle >= cycles) { //if update is too old
-				if (update->segment != NULL) {
-					update->segment->update--; //decrement the segment's pending updates marker
+	for (a = temporal_find_target(presynaptic, cell); a < presynaptic->target_count && presynaptic->targets[a].cell == cell;
+			a++) {
+		if (presynaptic->targets[a].segment == segment && presynaptic->targets[a].connected == connected) {
+			return a;
+		}
+	}
+	return -1;
+}
+
+//adds a synapse of the segment of cell "cell" to cell "presynaptic" to the reverse index, call when the synapse is created
+
+void temporal_index_synapse(Region* region, int presynaptic, int cell, Segment* segment, char connected) {
+	if (!CONNECTION_REVERSE_INDEX) {
+		return;
+	}
+	pthread_mutex_t* lock = &(region->target_locks[presynaptic % TARGET_LOCK_COUNT]);
+	pthread_mutex_lock(lock);
+	Cell* presynaptic_cell = &(region->cells[presynaptic]);
+	temporal_insert_target(presynaptic_cell, temporal_find_target(presynaptic_cell, cell + 1), cell, segment, connected);
+	pthread_mutex_unlock(lock);
+}
+
+//removes a synapse of the segment of cell "cell" to cell "presynaptic" from the reverse index, call when the synapse is removed
+
+void temporal_unindex_synapse(Region* region, int presynaptic, int cell, Segment* segment, char connected) {
+	if (!CONNECTION_REVERSE_INDEX) {
+		return;
+	}
+	pthread_mutex_t* lock = &(region->target_locks[presynaptic % TARGET_LOCK_COUNT]);
+	pthread_mutex_lock(lock);
+	Cell* presynaptic_cell = &(region->cells[presynaptic]);
+	int a = temporal_find_synapse_target(presynaptic_cell, cell, segment, connected);
+	if (a >= 0) {
+		memmove(presynaptic_cell->targets + a, presynaptic_cell->targets + a + 1,
+				(presynaptic_cell->target_count - a - 1) * sizeof(SegmentRef));
+		presynaptic_cell->target_count--;
+	}
+	pthread_mutex_unlock(lock);
+}
+
+//updates the connected flag of a synapse in the reverse index, call when the synapse's permanence crosses the threshold
+
+void temporal_reindex_synapse(Region* region, int presynaptic, int cell, Segment* segment, char connected) {
+	if (!CONNECTION_REVERSE_INDEX) {
+		return;
+	}
+	pthread_mutex_t* lock = &(region->target_locks[presynaptic % TARGET_LOCK_COUNT]);
+	pthread_mutex_lock(lock);
+	Cell* presynaptic_cell = &(region->cells[presynaptic]);
+	int a = temporal_find_synapse_target(presynaptic_cell, cell, segment, !connected);
+	if (a >= 0) {
+		presynaptic_cell->targets[a].connected = connected;
+	}
+	pthread_mutex_unlock(lock);
+}
+
+//merges the synapses of each segment to the same presynaptic cell into one with the highest permanence and the latest activity
+//checkpoints of regions that grew duplicate synapses are cleaned after loading, call before temporal_index_region(), returns the number of removed synapses
+
+long temporal_dedupe_region(Region* region) {
+	long removed = 0;
+	int a;
+	for (a = 0; a < COLUMN_COUNT * CELL_COUNT; a++) {
+		Cell* cell = &(region->cells[a]);
+		if (cell->synapse_count == 0) {
+			continue;
+		}
+		int* synapse_cells = malloc(cell->synapse_count * sizeof(int)); //new synapse arrays
+		perm_t* synapse_perms = malloc(cell->synapse_count * sizeof(perm_t));
+		long* synapse_cycles = malloc(cell->synapse_count * sizeof(long));
+		int count = 0; //number of kept synapses
+		List* segments = cell->segments;
+		while (segments != NULL) {
+			Segment* segment = (Segment*) segments->elem;
+			int first = count;
+			int b;
+			for (b = segment->first; b < segment->first + segment->synapse_count; b++) {
+				int c = first;
+				while (c < count && synapse_cells[c] != cell->synapse_cells[b]) { //search the kept synapses of the segment
+					c++;
 				}
-				List* connections = update->new_connections;
-				while (connections != NULL) { //remove all newly allocated connections in the update
-					Connection* connection = (Connection*) connections->elem;
-					free(connection);
-					connections = connections->next;
+				if (c < count) { //duplicate synapse
+					synapse_perms[c] = synapse_perms[c] > cell->synapse_perms[b] ? synapse_perms[c] : cell->synapse_perms[b];
+					synapse_cycles[c] = synapse_cycles[c] > cell->synapse_cycles[b] ? synapse_cycles[c] : cell->synapse_cycles[b];
+					removed++;
+					continue;
 				}
-				free_list(update->active_connections);
-				free_list(update->new_connections);
-				free_list(update->inactive_connections);
-				free(update);
+				synapse_cells[count] = cell->synapse_cells[b];
+				synapse_perms[count] = cell->synapse_perms[b];
+				synapse_cycles[count] = cell->synapse_cycles[b];
+				count++;
+			}
+			segment->first = first;
+			segment->synapse_count = count - first;
+			segment->connected_count = 0; //merged synapses may have crossed the threshold
+			for (b = first; b < count; b++) {
+				segment->connected_count += synapse_perms[b] >= CONNECTION_PERM_THRESHOLD;
+			}
+			segments = segments->next;
+		}
+		free(cell->synapse_cells); //assign new synapse arrays as current
+		free(cell->synapse_perms);
+		free(cell->synapse_cycles);
+		cell->synapse_capacity = cell->synapse_count;
+		cell->synapse_count = count;
+		cell->synapse_cells = synapse_cells;
+		cell->synapse_perms = synapse_perms;
+		cell->synapse_cycles = synapse_cycles;
+	}
+	region->synapse_count -= removed;
+	return removed;
+}
+
+//rebuilds the reverse index from the synapses of all segments, required after loading
+
+void temporal_index_region(Region* region) {
+	if (!CONNECTION_REVERSE_INDEX) {
+		return;
+	}
+	int a;
+	for (a = 0; a < COLUMN_COUNT * CELL_COUNT; a++) {
+		region->cells[a].target_count = 0;
+	}
+	for (a = 0; a < COLUMN_COUNT * CELL_COUNT; a++) { //cells in ascending order keep the targets sorted
+		Cell* cell = &(region->cells[a]);
+		List* segments = cell->segments;
+		while (segments != NULL) {
+			Segment* segment = (Segment*) segments->elem;
+			int b;
+			for (b = segment->first; b < segment->first + segment->synapse_count; b++) {
+				Cell* presynaptic = &(region->cells[cell->synapse_cells[b]]);
+				temporal_insert_target(presynaptic, presynaptic->target_count, a, segment,
+						cell->synapse_perms[b] >= CONNECTION_PERM_THRESHOLD);
+			}
+			segments = segments->next;
+		}
+	}
+}
+
+//resets the counts of the segment if they refer to an older cycle than "cycle"
+//segments with too few connected synapses to become active are marked weak, prediction then only counts their potential synapses
+
+void temporal_reset_counts(Segment* segment, long cycle) {
+	if (segment->count_cycle != cycle) { //segments not counted in a cycle had no synapses to active or learning cells
+		segment->count_cycle = cycle;
+		segment->weak = segment->connected_count < SEGMENT_ACTIVATION_THRESHOLD;
+		segment->active_count = 0;
+		segment->potential_count = 0;
+		segment->learning_count = 0;
+	}
+}
+
+//adds "sign" times a connected synapse to cell "presynaptic" to the counts of the segment against "states", the cell states of "cycle"
+
+void temporal_count_connection(Segment* segment, CellStates* states, long cycle, int presynaptic, int sign) {
+	temporal_reset_counts(segment, cycle);
+	if (packed_is_set(states->active, presynaptic)) {
+		segment->active_count += sign;
+	}
+	if (packed_is_set(states->learning, presynaptic)) {
+		segment->learning_count += sign;
+	}
+}
+
+//adds "sign" times a synapse to cell "presynaptic" to the counts of the segment against "states", the cell states of "cycle"
+
+void temporal_count_synapse(Segment* segment, CellStates* states, long cycle, int presynaptic, char connected, int sign) {
+	temporal_reset_counts(segment, cycle);
+	if (packed_is_set(states->active, presynaptic)) {
+		segment->potential_count += sign;
+	}
+	if (connected) {
+		temporal_count_connection(segment, states, cycle, presynaptic, sign);
+	}
+}
+
+//returns 1 if the segment of the cell has a synapse to cell "presynaptic", segments are small enough for a linear search
+
+char temporal_has_synapse(Cell* cell, Segment* segment, int presynaptic) {
+	int a;
+	for (a = segment->first; a < segment->first + segment->synapse_count; a++) {
+		if (cell->synapse_cells[a] == presynaptic) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//removes the synapse at "position" of the segment of the cell, synapses of segments stored behind the segment are moved
+//the segment must not have pending updates, they refer to its synapses by position
+
+void temporal_remove_synapse(Region* region, Cell* cell, Segment* segment, int position) {
+	int presynaptic = cell->synapse_cells[position];
+	char connected = cell->synapse_perms[position] >= CONNECTION_PERM_THRESHOLD;
+	temporal_unindex_synapse(region, presynaptic, cell->index, segment, connected);
+	temporal_count_synapse(segment, region->state, region->cycle, presynaptic, connected, -1);
+	segment->connected_count -= connected;
+	int tail = cell->synapse_count - position - 1; //number of synapses to be moved
+	memmove(cell->synapse_cells + position, cell->synapse_cells + position + 1, tail * sizeof(int));
+	memmove(cell->synapse_perms + position, cell->synapse_perms + position + 1, tail * sizeof(perm_t));
+	memmove(cell->synapse_cycles + position, cell->synapse_cycles + position + 1, tail * sizeof(long));
+	List* segments = cell->segments;
+	while (segments != NULL) {
+		Segment* other = (Segment*) segments->elem;
+		if (other != segment && other->first > position) {
+			other->first--;
+		}
+		segments = segments->next;
+	}
+	segment->synapse_count--;
+	cell->synapse_count--;
+	__atomic_fetch_sub(&(region->synapse_count), 1, __ATOMIC_RELAXED); //jobs of the thread pool share the counter
+}
+
+//returns the position of the synapse of the segment with the lowest permanence, the least recently active one among equals
+
+int temporal_weakest_synapse(Cell* cell, Segment* segment) {
+	int weakest = segment->first;
+	int a;
+	for (a = segment->first + 1; a < segment->first + segment->synapse_count; a++) {
+		if (cell->synapse_perms[a] < cell->synapse_perms[weakest]
+				|| (cell->synapse_perms[a] == cell->synapse_perms[weakest]
+						&& cell->synapse_cycles[a] < cell->synapse_cycles[weakest])) {
+			weakest = a;
+		}
+	}
+	return weakest;
+}
+
+//removes the segment and its synapses from the cell and returns it to the slabs
+//the segment must not have pending updates, they would refer to the freed segment
+
+void temporal_remove_segment(Region* region, Cell* cell, Segment* segment) {
+	RegionSlabs* slabs = region_slabs(region);
+	int end = segment->first + segment->synapse_count;
+	int count = segment->synapse_count;
+	int a;
+	for (a = segment->first; a < end; a++) {
+		temporal_unindex_synapse(region, cell->synapse_cells[a], cell->index, segment,
+				cell->synapse_perms[a] >= CONNECTION_PERM_THRESHOLD);
+	}
+	int tail = cell->synapse_count - end; //number of synapses to be moved
+	if (tail > 0) { //the synapse arrays are NULL if the cell never had synapses
+		memmove(cell->synapse_cells + segment->first, cell->synapse_cells + end, tail * sizeof(int));
+		memmove(cell->synapse_perms + segment->first, cell->synapse_perms + end, tail * sizeof(perm_t));
+		memmove(cell->synapse_cycles + segment->first, cell->synapse_cycles + end, tail * sizeof(long));
+	}
+	List* previous = NULL;
+	List* segments = cell->segments;
+	char found = 0;
+	while (segments != NULL) {
+		Segment* other = (Segment*) segments->elem;
+		List* next = segments->next;
+		if (other == segment) { //unlink the segment's node
+			if (previous != NULL) {
+				previous->next = next;
 			} else {
-				new_segment_updates = add_elem((long) update, new_segment_updates); //else: add update to new list of updates
+				cell->segments = next;
+			}
+			slab_free(&(slabs->lists), segments);
+			found = 1;
+		} else {
+			if (!found) { //nodes in front of the removed one count it in their length
+				segments->len--;
+			}
+			if (other->first >= end && count > 0) {
+				other->first -= count;
+			}
+			previous = segments;
+		}
+		segments = next;
+	}
+	cell->synapse_count -= count;
+	slab_free(&(slabs->segments), segment);
+	__atomic_fetch_sub(&(region->segment_count), 1, __ATOMIC_RELAXED); //jobs of the thread pool share the counters
+	__atomic_fetch_sub(&(region->synapse_count), count, __ATOMIC_RELAXED);
+}
+
+//returns the least recently active segment of the cell without pending updates, NULL if there is none
+
+Segment* temporal_oldest_segment(Cell* cell) {
+	Segment* oldest = NULL;
+	List* segments = cell->segments;
+	while (segments != NULL) {
+		Segment* segment = (Segment*) segments->elem;
+		if (segment->update == 0 && (oldest == NULL || segment->active_cycle < oldest->active_cycle)) {
+			oldest = segment;
+		}
+		segments = segments->next;
+	}
+	return oldest;
+}
+
+//appends "count" synapses to the presynaptic cells "cells" to the segment of the cell, the new synapses start with permanence "perm" and activity timestamp "cycle"
+//synapses of segments stored behind the segment are moved, the new synapses are counted against the current cell states
+//cells the segment already has a synapse to are skipped and removed from "cells", so a segment has at most one synapse per presynaptic cell
+//with SEGMENT_MAX_SYNAPSES the weakest synapses are evicted to make room, new synapses not fitting into the segment are dropped
+
+void temporal_add_synapses(Region* region, Cell* cell, Segment* segment, int* cells, int count, perm_t perm, long cycle) {
+	if (segment->synapse_count > 0 && count > 0) { //updates of the same segment may have added synapses since "cells" were chosen
+		int kept = 0;
+		int a;
+		for (a = 0; a < count; a++) {
+			if (!temporal_has_synapse(cell, segment, cells[a])) {
+				cells[kept++] = cells[a];
+			}
+		}
+		count = kept;
+	}
+	if (SEGMENT_MAX_SYNAPSES > 0) {
+		long evicted = 0;
+		while (segment->update == 0 && segment->synapse_count > 0 && segment->synapse_count + count > SEGMENT_MAX_SYNAPSES) { //pending updates refer to the synapses by position
+			temporal_remove_synapse(region, cell, segment, temporal_weakest_synapse(cell, segment));
+			evicted++;
+		}
+		__atomic_fetch_add(&(region->evicted_synapses), evicted, __ATOMIC_RELAXED);
+		if (segment->synapse_count + count > SEGMENT_MAX_SYNAPSES) {
+			count = SEGMENT_MAX_SYNAPSES - segment->synapse_count;
+		}
+	}
+	if (count <= 0) {
+		return;
+	}
+	temporal_reserve_synapses(cell, count);
+	int end = segment->first + segment->synapse_count; //position of the new synapses
+	int tail = cell->synapse_count - end; //number of synapses to be moved
+	if (tail > 0) {
+		memmove(cell->synapse_cells + end + count, cell->synapse_cells + end, tail * sizeof(int));
+		memmove(cell->synapse_perms + end + count, cell->synapse_perms + end, tail * sizeof(perm_t));
+		memmove(cell->synapse_cycles + end + count, cell->synapse_cycles + end, tail * sizeof(long));
+	}
+	List* segments = cell->segments;
+	while (segments != NULL) { //move the segments behind, including empty ones starting at "end"
+		Segment* other = (Segment*) segments->elem;
+		if (other != segment && other->first >= end) {
+			other->first += count;
+		}
+		segments = segments->next;
+	}
+	char connected = perm >= CONNECTION_PERM_THRESHOLD;
+	int a;
+	for (a = 0; a < count; a++) {
+		cell->synapse_cells[end + a] = cells[a];
+		cell->synapse_perms[end + a] = perm;
+		cell->synapse_cycles[end + a] = cycle;
+		temporal_index_synapse(region, cells[a], cell->index, segment, connected);
+		temporal_count_synapse(segment, region->state, region->cycle, cells[a], connected, 1);
+	}
+	segment->synapse_count += count;
+	segment->connected_count += connected ? count : 0;
+	cell->synapse_count += count;
+	__atomic_fetch_add(&(region->synapse_count), count, __ATOMIC_RELAXED);
+}
+
+//allocates a segment without synapses and adds it to the cell, "cycle" is its activity timestamp
+
+Segment* temporal_new_segment(Region* region, Cell* cell, long cycle) {
+	RegionSlabs* slabs = region_slabs(region);
+	Segment* segment = slab_alloc(&(slabs->segments));
+	segment->update = 0;
+	segment->active_cycle = cycle;
+	segment->state_cycle = -1;
+	segment->activity = 0;
+	segment->active = 0;
+	segment->prev_active = 0;
+	segment->learning = 0;
+	segment->prev_learning = 0;
+	segment->first = cell->synapse_count;
+	segment->synapse_count = 0;
+	segment->connected_count = 0;
+	segment->count_cycle = cycle; //no synapses yet
+	segment->weak = 1;
+	segment->active_count = 0;
+	segment->potential_count = 0;
+	segment->learning_count = 0;
+	cell->segments = add_slab_elem((long) segment, cell->segments, &(slabs->lists));
+	__atomic_fetch_add(&(region->segment_count), 1, __ATOMIC_RELAXED); //jobs of the thread pool share the counter
+	return segment;
+}
+
+//helper function to order segments by their last activity, the cell and the position of their synapses break ties
+
+int temporal_comp_segments(const void* a, const void* b) {
+	SegmentRef* ref_a = (SegmentRef*) a;
+	SegmentRef* ref_b = (SegmentRef*) b;
+	if (ref_a->segment->active_cycle != ref_b->segment->active_cycle) {
+		return ref_a->segment->active_cycle < ref_b->segment->active_cycle ? -1 : 1;
+	}
+	if (ref_a->cell != ref_b->cell) {
+		return ref_a->cell < ref_b->cell ? -1 : 1;
+	}
+	return ref_a->segment->first - ref_b->segment->first;
+}
+
+//evicts the least recently active segments without pending updates if the region holds more than REGION_MAX_SYNAPSES synapses
+//eviction continues down to 15/16 of the limit so that the segments are not searched again in the following cycles
+//call after temporal_apply_updates(), the counts of the current cycle are kept up to date
+
+void temporal_limit_synapses(Region* region) {
+	if (REGION_MAX_SYNAPSES <= 0 || region->synapse_count <= REGION_MAX_SYNAPSES) {
+		return;
+	}
+	long target = REGION_MAX_SYNAPSES - REGION_MAX_SYNAPSES / 16;
+	SegmentRef* candidates = malloc(region->segment_count * sizeof(SegmentRef));
+	int count = 0;
+	int a;
+	for (a = 0; a < COLUMN_COUNT * CELL_COUNT; a++) {
+		List* segments = region->cells[a].segments;
+		while (segments != NULL) {
+			Segment* segment = (Segment*) segments->elem;
+			if (segment->update == 0) {
+				candidates[count].cell = a;
+				candidates[count].segment = segment;
+				count++;
+			}
+			segments = segments->next;
+		}
+	}
+	qsort(candidates, count, sizeof(SegmentRef), temporal_comp_segments);
+	for (a = 0; a < count && region->synapse_count > target; a++) {
+		region->evicted_segments++;
+		region->evicted_synapses += candidates[a].segment->synapse_count;
+		temporal_remove_segment(region, &(region->cells[candidates[a].cell]), candidates[a].segment);
+	}
+	free(candidates);
+}
+
+//returns the bytes held by the segments and synapses of the region, spare capacity of the synapse arrays is not included
+
+long temporal_memory_bytes(Region* region) {
+	long synapse_bytes = sizeof(int) + sizeof(perm_t) + sizeof(long) + (CONNECTION_REVERSE_INDEX ? sizeof(SegmentRef) : 0); //synapse arrays and reverse index
+	return region->segment_count * (long) (sizeof(Segment) + sizeof(List)) + region->synapse_count * synapse_bytes;
+}
+
+//returns the calling thread's arena for the updates of the current cycle
+
+Arena* temporal_update_arena(Region* region) {
+	return &(region_slabs(region)->updates[region->cycle % 2]);
+}
+
+//returns the presynaptic cells of the segment's synapses in ascending order
+//the array is scratch space from the calling thread's update arena and is released when the arena is reset
+
+int* temporal_presynaptic_cells(Region* region, Cell* cell, Segment* segment) {
+	int* cells = arena_alloc(temporal_update_arena(region), segment->synapse_count * sizeof(int));
+	memcpy(cells, cell->synapse_cells + segment->first, segment->synapse_count * sizeof(int));
+	qsort(cells, segment->synapse_count, sizeof(int), comp_ints);
+	return cells;
+}
+
+//allocates an update for the segment of the cell from the arena of the current cycle and adds it to the cell's pending updates
+//"segment" is NULL if the update creates a new segment
+
+Update* temporal_new_update(Region* region, Cell* cell, Segment* segment) {
+	Update* update = arena_alloc(temporal_update_arena(region), sizeof(Update));
+	update->active_cycle = region->cycle;
+	update->segment = segment;
+	update->next = cell->segment_updates;
+	cell->segment_updates = update;
+	update->synapse_count = 0;
+	update->active_synapses = NULL;
+	update->active_count = 0;
+	update->new_cells = NULL;
+	update->new_count = 0;
+	return update;
+}
+
+//copies the pending updates of the cell created before the current cycle into the arena of the current cycle
+//temporal_region_cycle() resets the arena of the previous cycle, so updates kept for later cycles must not remain there
+
+void temporal_carry_updates(Region* region, Cell* cell) {
+	Arena* arena = temporal_update_arena(region);
+	Update** link = &(cell->segment_updates);
+	while (*link != NULL) {
+		Update* update = *link;
+		if (update->active_cycle != region->cycle) { //update is stored in the arena of the previous cycle
+			Update* copy = arena_alloc(arena, sizeof(Update));
+			*copy = *update;
+			if (update->active_synapses != NULL) {
+				int words = (update->synapse_count + 63) / 64;
+				copy->active_synapses = arena_alloc(arena, words * sizeof(uint64_t));
+				memcpy(copy->active_synapses, update->active_synapses, words * sizeof(uint64_t));
+			}
+			if (update->new_cells != NULL) {
+				copy->new_cells = arena_alloc(arena, update->new_count * sizeof(int));
+				memcpy(copy->new_cells, update->new_cells, update->new_count * sizeof(int));
 			}
-			segment_updates = segment_updates->next;
+			*link = copy;
+			update = copy;
 		}
-		free_list(cell->segment_updates); //free now old list of updates
-		cell->segment_updates = new_segment_updates; //assign new list of updates as current
+		link = &(update->next);
 	}
 }
 
+//removes old and unused updates inside a column, returns the number of removed updates
+//the updates of a cell are ordered newest first, so the old ones are cut off the end of the list, their memory is reclaimed with the arenas
+
+int temporal_column_forget_updates(Column* column, long cycle, long cycles) {
+	int removed = 0;
+	int a;
+	for (a = 0; a < CELL_COUNT; a++) {
+		Cell* cell = &(column->cells[a]);
+		Update** link = &(cell->segment_updates);
+		while (*link != NULL && cycle - (*link)->active_cycle < cycles) { //skip the recent updates
+			link = &((*link)->next);
+		}
+		Update* update = *link;
+		*link = NULL;
+		while (update != NULL) { //if update is too old
+			if (update->segment != NULL) {
+				update->segment->update--; //decrement the segment's pending updates marker
+			}
+			removed++;
+			update = update->next;
+		}
+	}
+	return removed;
+}
+
 //removes old and unused updates inside columns between index "from" and "to"
 
 void temporal_region_forget_updates(Region* region, int from, int to) {
+	long removed = 0;
 	int a;
 	for (a = from; a <= to; a++) {
 		Column* column = &(region->columns[a]);
-		temporal_column_forget_updates(column, region->cycle, FORGET_INTERVAL);
+		removed += temporal_column_forget_updates(column, region->cycle, FORGET_INTERVAL);
 	}
+	__atomic_fetch_add(&(region->reclaimed_updates), removed, __ATOMIC_RELAXED); //jobs of the thread pool share the counter
 }
 
-//removes old and unused segments and connections inside a column
+//removes old and unused segments and synapses inside a column, call after temporal_region_cycle()
+//the kept synapses of a cell are collected in the thread's scratch buffer in the order of the new list of segments and copied back
 
-void temporal_column_forget_segments(Column* column, long cycle, long cycles) {
+void temporal_column_forget_segments(Region* region, Column* column, long cycle, long cycles) {
+	RegionSlabs* slabs = region_slabs(region);
+	long removed_segments = 0;
+	long removed_synapses = 0;
 	int a;
 	for (a = 0; a < CELL_COUNT; a++) {
 		Cell* cell = &(column->cells[a]);
+		size_t size = cell->synapse_count * (sizeof(long) + sizeof(perm_t) + sizeof(int));
+		if (size > slabs->scratch_size) {
+			slabs->scratch_size = size > 2 * slabs->scratch_size ? size : 2 * slabs->scratch_size;
+			slabs->scratch = realloc(slabs->scratch, slabs->scratch_size);
+		}
+		long* synapse_cycles = (long*) slabs->scratch; //kept synapses, longs first to keep every array aligned
+		perm_t* synapse_perms = (perm_t*) (synapse_cycles + cell->synapse_count);
+		int* synapse_cells = (int*) (synapse_perms + cell->synapse_count);
+		int count = 0; //number of kept synapses
 		List* segments = cell->segments; //current list of segments
 		List* new_segments = NULL; //new list of segments
 		while (segments != NULL) {
 			Segment* segment = (Segment*) segments->elem;
 			char rem = 0; //segment to be removed variable
-			if (segment->update == 0) { //if segment has no pending updates
-				if (cycle - segment->active_cycle >= cycles) { //if segment inactive for too long
-					rem = 1; //mark segment for removal
-				}
-				List* connections = segment->connections; //current list of connections
-				List* new_connections = NULL; //new list of connections
-				while (connections != NULL) {
-					Connection* connection = (Connection*) connections->elem;
-					if (rem || cycle - connection->active_cycle >= cycles || connection->perm == 0.0) { //if segment marked for removal OR connection inactive for too long OR connection permanence equals 0
-						free(connection); //free connection
-					} else {
-						new_connections = add_elem((long) connection, new_connections); //add connection to new list of connections
-					}
-					connections = connections->next;
-				}
-				free_list(segment->connections); //free now old list of connections
-				segment->connections = new_connections; //assign new list of connections as current
+			if (segment->update == 0 && cycle - segment->active_cycle >= cycles) { //if segment has no pending updates AND segment inactive for too long
+				rem = 1; //mark segment for removal
 			}
+			int b;
 			if (rem) { //if segment marked for removal
-				free(segment); //free segment
+				for (b = segment->first; b < segment->first + segment->synapse_count; b++) {
+					temporal_unindex_synapse(region, cell->synapse_cells[b], cell->index, segment,
+							cell->synapse_perms[b] >= CONNECTION_PERM_THRESHOLD);
+				}
+				removed_segments++;
+				removed_synapses += segment->synapse_count;
+				slab_free(&(slabs->segments), segment); //free segment
 			} else {
-				new_segments = add_elem((long) segment, new_segments); //add segment to new list of segments
+				int first = count;
+				for (b = segment->first; b < segment->first + segment->synapse_count; b++) {
+					if (segment->update == 0
+							&& (cycle - cell->synapse_cycles[b] >= cycles || cell->synapse_perms[b] == 0)) { //if segment has no pending updates AND (synapse inactive for too long OR synapse permanence equals 0)
+						char connected = cell->synapse_perms[b] >= CONNECTION_PERM_THRESHOLD;
+						temporal_unindex_synapse(region, cell->synapse_cells[b], cell->index, segment, connected);
+						temporal_count_synapse(segment, region->prev_state, region->count_cycle, cell->synapse_cells[b], connected, -1);
+						segment->connected_count -= connected;
+						removed_synapses++;
+						continue; //drop synapse
+					}
+					synapse_cells[count] = cell->synapse_cells[b];
+					synapse_perms[count] = cell->synapse_perms[b];
+					synapse_cycles[count] = cell->synapse_cycles[b];
+					count++;
+				}
+				segment->first = first;
+				segment->synapse_count = count - first;
+				new_segments = add_slab_elem((long) segment, new_segments, &(slabs->lists)); //add segment to new list of segments
 			}
 			segments = segments->next;
 		}
-		free_list(cell->segments); //free now old list of segments
+		free_slab_list(cell->segments, &(slabs->lists)); //free now old list of segments
 		cell->segments = new_segments; //assign new list of segments as current
+		if (count > 0) { //kept synapses replace the cell's synapses, the arrays keep their capacity
+			memcpy(cell->synapse_cells, synapse_cells, count * sizeof(int));
+			memcpy(cell->synapse_perms, synapse_perms, count * sizeof(perm_t));
+			memcpy(cell->synapse_cycles, synapse_cycles, count * sizeof(long));
+		}
+		cell->synapse_count = count;
 	}
+	__atomic_fetch_add(&(region->reclaimed_segments), removed_segments, __ATOMIC_RELAXED); //jobs of the thread pool share the counters
+	__atomic_fetch_add(&(region->reclaimed_synapses), removed_synapses, __ATOMIC_RELAXED);
+	__atomic_fetch_sub(&(region->segment_count), removed_segments, __ATOMIC_RELAXED);
+	__atomic_fetch_sub(&(region->synapse_count), removed_synapses, __ATOMIC_RELAXED);
 }
 
 //removes old and unused segments and connections inside columns between index "from" and "to"
@@ -102,7 +674,21 @@ void temporal_region_forget_segments(Region* region, int from, int to) {
 	int a;
 	for (a = from; a <= to; a++) {
 		Column* column = &(region->columns[a]);
-		temporal_column_forget_segments(column, region->cycle, FORGET_INTERVAL);
+		temporal_column_forget_segments(region, column, region->cycle, FORGET_INTERVAL);
+	}
+}
+
+//runs the garbage collector on the next FORGET_BUDGET columns, continuing after the last column swept by the previous call
+//a full pass takes COLUMN_COUNT / FORGET_BUDGET cycles, a column loses its unused segments and synapses whenever it is swept
+//instead of only in cycles divisible by FORGET_INTERVAL, so the mode changes when they are reclaimed and with it the model output
+
+void temporal_forget_columns(Region* region) {
+	int a;
+	for (a = 0; a < FORGET_BUDGET && a < COLUMN_COUNT; a++) {
+		int column = region->forget_column;
+		temporal_region_forget_updates(region, column, column);
+		temporal_region_forget_segments(region, column, column);
+		region->forget_column = column + 1 < COLUMN_COUNT ? column + 1 : 0;
 	}
 }
 
@@ -112,76 +698,145 @@ void temporal_reset_region(Region* region) {
 	region->cycle++;
 	region->bursts = 0;
 }
-void temporal_reset_prediction(Region* region) {
+
+//sets the cell in the state's bits and appends it to the state's cells, cells must be kept in ascending order
+
+void temporal_keep_cell(PackedSDR* bits, SparseSDR* cells, int cell) {
+	packed_set(bits, cell);
+	cells->indices[cells->count++] = cell;
+}
+
+//proceeds to the next timestep by swapping the buffers of the current and previous cell states, resets the update arenas of the next cycle
+//cells store the cycle their states expire in, so only states lasting longer than one timestep need to be carried over
+//segment states are stamped with their cycle and roll over in temporal_segment_rollover() instead
+
+void temporal_region_cycle(Region* region) {
+	CellStates* prev = region->state;
+	region->state = region->prev_state;
+	region->prev_state = prev;
+	region->count_cycle = region->cycle; //temporal_predict_cells() counted the segments against the states of this cycle
+	CellStates* state = region->state;
+	packed_clear(state->active);
+	packed_clear(state->predictive);
+	packed_clear(state->learning);
+	state->active_cells->count = 0;
+	state->predictive_cells->count = 0;
+	state->learning_cells->count = 0;
+	long next = region->cycle + 1; //cycle of the new current states
 	int a;
-	for (a = 0; a < COLUMN_COUNT; a++) {
-		Column* column = &(region->columns[a]);
-		int b;
-		for (b = 0; b < CELL_COUNT; b++) {
-			Cell* cell = &(column->cells[b]);
-			if (cell->predictive) {
-				cell->predictive = 1;
+	for (a = 0; a < region->slab_count; a++) { //temporal_apply_updates() applied or carried over the updates of the previous cycle
+		reset_arena(&(region->slabs[a].updates[next % 2]));
+	}
+	if (CELL_REMAIN_ACTIVE > 1) { //states may outlast the timestep
+		for (a = 0; a < prev->active_cells->count; a++) {
+			int cell = prev->active_cells->indices[a];
+			if (region->timers[cell].active_until > next) { //if cell remains active
+				temporal_keep_cell(state->active, state->active_cells, cell);
+			}
+		}
+	}
+	if (CELL_REMAIN_PREDICTIVE > 1) {
+		for (a = 0; a < prev->predictive_cells->count; a++) {
+			int cell = prev->predictive_cells->indices[a];
+			if (region->timers[cell].predictive_until > next) { //if cell remains predictive
+				temporal_keep_cell(state->predictive, state->predictive_cells, cell);
+			}
+		}
+	}
+	if (CELL_REMAIN_LEARNING > 1) {
+		for (a = 0; a < prev->learning_cells->count; a++) {
+			int cell = prev->learning_cells->indices[a];
+			if (region->timers[cell].learning_until > next) { //if cell remains learning
+				temporal_keep_cell(state->learning, state->learning_cells, cell);
 			}
 		}
 	}
 }
 
-//updates the state of a column and its substructures for the next timestep
+//sets cell "cell" to active state for its remain_active timesteps
 
-void temporal_column_cycle(Column* column) {
-	int a;
-	for (a = 0; a < CELL_COUNT; a++) {
-		Cell* cell = &(column->cells[a]);
-		cell->prev_active = cell->active;
-		cell->prev_predictive = cell->predictive;
-		cell->prev_learning = cell->learning;
-		cell->active = cell->active == 0 ? 0 : cell->active - 1;
-		cell->predictive = cell->predictive == 0 ? 0 : cell->predictive - 1;
-		cell->learning = cell->learning == 0 ? 0 : cell->learning - 1;
-		List* segments = cell->segments;
-		while (segments != NULL) {
-			Segment* segment = (Segment*) segments->elem;
-			segment->activity = 0;
-			segment->prev_active = segment->active;
-			segment->prev_learning = segment->learning;
-			segment->active = 0;
-			segment->learning = 0;
-			segments = segments->next;
-		}
+void temporal_set_active(Region* region, int cell) {
+	region->timers[cell].active_until = region->cycle + region->timers[cell].remain_active;
+	packed_set_atomic(region->state->active, cell);
+}
+
+//sets the expiry of the predictive state of cell "cell", the expiry of the previous timestep is kept for temporal_prev_predictive_until()
+
+void temporal_predictive_until(Region* region, int cell, long until) {
+	CellTimer* timer = &(region->timers[cell]);
+	if (timer->predictive_cycle != region->cycle) { //first change in this cycle
+		timer->prev_predictive_until = timer->predictive_until;
+		timer->predictive_cycle = region->cycle;
 	}
+	timer->predictive_until = until;
 }
 
-//proceeds to the next timestep for all columns between index "from" and "to"
+//returns the cycle the predictive state of cell "cell" expired in as of the previous timestep
+
+long temporal_prev_predictive_until(Region* region, int cell) {
+	CellTimer* timer = &(region->timers[cell]);
+	return timer->predictive_cycle == region->cycle ? timer->prev_predictive_until : timer->predictive_until;
+}
 
-void temporal_region_cycle(Region* region, int from, int to) {
+//sets cell "cell" to predictive state for its remain_predictive timesteps
+
+void temporal_set_predictive(Region* region, int cell) {
+	temporal_predictive_until(region, cell, region->cycle + region->timers[cell].remain_predictive);
+	packed_set_atomic(region->state->predictive, cell);
+}
+
+//sets cell "cell" to learning state for its remain_learning timesteps
+
+void temporal_set_learning(Region* region, int cell) {
+	region->timers[cell].learning_until = region->cycle + region->timers[cell].remain_learning;
+	packed_set_atomic(region->state->learning, cell);
+}
+
+//sets the predictive states of the current timestep to expire in the next cycle
+
+void temporal_reset_prediction(Region* region) {
 	int a;
-	for (a = from; a <= to; a++) {
-		Column* column = &(region->columns[a]);
-		temporal_column_cycle(column);
+	for (a = 0; a < region->state->predictive_cells->count; a++) {
+		temporal_predictive_until(region, region->state->predictive_cells->indices[a], region->cycle + 1);
 	}
 }
 
-//initializes a column
+//moves the states of the segment to "cycle", the states of the cycle before become the previous states, older states are dropped
 
-void temporal_init_column(Column* column, int column_index) {
+void temporal_segment_rollover(Segment* segment, long cycle) {
+	if (segment->state_cycle != cycle) {
+		char recent = segment->state_cycle == cycle - 1; //states were computed in the previous cycle
+		segment->prev_active = recent && segment->active;
+		segment->prev_learning = recent && segment->learning;
+		segment->activity = 0;
+		segment->active = 0;
+		segment->learning = 0;
+		segment->state_cycle = cycle;
+	}
+}
+
+//initializes the column with index "column_index"
+
+void temporal_init_column(Region* region, int column_index) {
+	Column* column = &(region->columns[column_index]);
 	int a;
 	for (a = 0; a < CELL_COUNT; a++) {
 		Cell* cell = &(column->cells[a]);
-		cell->active = 0;
-		cell->prev_active = 0;
-		cell->predictive = 0;
-		cell->prev_predictive = 0;
-		cell->learning = 0;
-		cell->prev_learning = 0;
 		cell->index = a + column_index * CELL_COUNT;
+		CellTimer* timer = &(region->timers[cell->index]);
+		timer->active_until = 0;
+		timer->predictive_until = 0;
+		timer->predictive_cycle = -1;
+		timer->prev_predictive_until = 0;
+		timer->learning_until = 0;
 		if (CELL_REMAIN_RANDOM) {
-			cell->remain_active = (rand() % CELL_REMAIN_ACTIVE) + 1;
-			cell->remain_predictive = (rand() % CELL_REMAIN_PREDICTIVE) + 1;
-			cell->remain_learning = (rand() % CELL_REMAIN_LEARNING) + 1;
+			timer->remain_active = (rand() % CELL_REMAIN_ACTIVE) + 1;
+			timer->remain_predictive = (rand() % CELL_REMAIN_PREDICTIVE) + 1;
+			timer->remain_learning = (rand() % CELL_REMAIN_LEARNING) + 1;
 		} else {
-			cell->remain_active = CELL_REMAIN_ACTIVE;
-			cell->remain_predictive = CELL_REMAIN_PREDICTIVE;
-			cell->remain_learning = CELL_REMAIN_LEARNING;
+			timer->remain_active = CELL_REMAIN_ACTIVE;
+			timer->remain_predictive = CELL_REMAIN_PREDICTIVE;
+			timer->remain_learning = CELL_REMAIN_LEARNING;
 		}
 	}
 }
@@ -191,33 +846,50 @@ void temporal_init_column(Column* column, int column_index) {
 void temporal_init_region(Region* region) {
 	int a;
 	for (a = 0; a < COLUMN_COUNT; a++) {
-		Column* column = &(region->columns[a]);
-		temporal_init_column(column, a);
+		temporal_init_column(region, a);
 	}
 	region->bursts = 0;
 }
 
 //updates the state of all segments inside a cell
 
-void temporal_activate_segments(Cell* cell, long cycle) {
+void temporal_activate_segments(Region* region, Cell* cell, long cycle) {
+	char counted = region->count_cycle == cycle - 1; //the prediction of the previous cycle cached the counts
 	List* segments = cell->segments;
 	while (segments != NULL) {
 		Segment* segment = (Segment*) segments->elem;
-		int active = 0; //number of connections pointing to cells active in previous timestep
-		int learning = 0; //number of connections pointing to cells learning in previous timestep
-		List* connections = segment->connections;
-		while (connections != NULL) {
-			Connection* connection = (Connection*) connections->elem;
-			if (connection->perm >= CONNECTION_PERMANENCE_THRESHOLD) { //if connection's permanence reaches threshold
-				if (connection->cell->prev_active) { //if connection points to cell active in previous timestep
-					active++;
-					connection->active_cycle = cycle; //set activity timestamp
+		temporal_segment_rollover(segment, cycle);
+		int active = 0; //number of synapses pointing to cells active in previous timestep
+		int learning = 0; //number of synapses pointing to cells learning in previous timestep
+		int b;
+		if (counted && !(segment->count_cycle == cycle - 1 && segment->weak)) { //weak segments have no cached active and learning counts
+			if (segment->count_cycle == cycle - 1) {
+				active = segment->active_count;
+				learning = segment->learning_count;
+			}
+			int found = 0; //connected synapses to active cells visited
+			for (b = segment->first; found < active && b < segment->first + segment->synapse_count; b++) { //only the activity timestamps of the "active" synapses are left to set
+				if (cell->synapse_perms[b] >= CONNECTION_PERM_THRESHOLD
+						&& packed_is_set(region->prev_state->active, cell->synapse_cells[b])) {
+					cell->synapse_cycles[b] = cycle;
+					found++;
 				}
-				if (connection->cell->prev_learning) { //if connection points to cell learning in previous timestep
-					learning++;
+			}
+		} else {
+			int connected = 0; //connected synapses visited
+			for (b = segment->first; connected < segment->connected_count && b < segment->first + segment->synapse_count; b++) { //synapses behind the last connected one add nothing
+				if (cell->synapse_perms[b] >= CONNECTION_PERM_THRESHOLD) { //if synapse's permanence reaches threshold
+					connected++;
+					int presynaptic = cell->synapse_cells[b];
+					if (packed_is_set(region->prev_state->active, presynaptic)) { //if synapse points to cell active in previous timestep
+						active++;
+						cell->synapse_cycles[b] = cycle; //set activity timestamp
+					}
+					if (packed_is_set(region->prev_state->learning, presynaptic)) { //if synapse points to cell learning in previous timestep
+						learning++;
+					}
 				}
 			}
-			connections = connections->next;
 		}
 		segment->activity = active; //set segment's activity
 		if (active >= SEGMENT_ACTIVATION_THRESHOLD) { //if segment's activity reaches activation threshold
@@ -236,11 +908,12 @@ void temporal_activate_segments(Cell* cell, long cycle) {
 	}
 }
 
-//searches the learning area of a cell for other learning cells to form new connections to
+//searches the learning area of a cell for other learning cells to form new connections to, using the collected learning cells
+//cells the update's segment already has a synapse to are not chosen again
 
 void temporal_add_new_connections(Region* region, int column_index, int cell_index, char prev, Update* update,
-		int count) {
-	List* available_cells = NULL; //list of available cells to form new connections to
+		int count, unsigned int* seed) {
+	SparseSDR* learning = prev ? region->prev_state->learning_cells : region->state->learning_cells; //cells to choose from
 	int column_from = column_index - CONNECTION_LEARNING_HORIZONTAL; //start searching at column index == column_from
 	int column_to = column_index + CONNECTION_LEARNING_HORIZONTAL; //stop searching at column index == column_to
 	column_from = column_from < 0 ? 0 : column_from;
@@ -249,71 +922,67 @@ void temporal_add_new_connections(Region* region, int column_index, int cell_ind
 	int cell_to = cell_index + CONNECTION_LEARNING_VERTICAL; //stop searching at cell index == cell_from
 	cell_from = cell_from < 0 ? 0 : cell_from;
 	cell_to = cell_to >= CELL_COUNT ? CELL_COUNT - 1 : cell_to;
+	int first = sparse_lower_bound(learning, column_from * CELL_COUNT); //learning cells of the columns in search space
+	int last = sparse_lower_bound(learning, (column_to + 1) * CELL_COUNT);
+	if (first == last) {
+		return;
+	}
+	int* connected = NULL; //cells the update's segment already has a synapse to, ascending
+	int connected_count = 0;
+	if (update->segment != NULL) {
+		connected = temporal_presynaptic_cells(region, &(region->columns[column_index].cells[cell_index]), update->segment);
+		connected_count = update->segment->synapse_count;
+	}
+	int* available_cells = arena_alloc(temporal_update_arena(region), (last - first) * sizeof(int)); //available cells to form new connections to, scratch space like "connected"
+	int len = 0;
+	int c = 0; //position in the connected cells
 	int a;
-	for (a = column_from; a <= column_to; a++) { //iterate through columns in search space
-		Column* column = &(region->columns[a]);
-		int b;
-		for (b = cell_from; b <= cell_to; b++) { //iterate through cells in search space
-			Cell* cell = &(column->cells[b]);
-			if (prev && cell->prev_learning) { //if cell was learning in previous timestep
-				available_cells = add_elem((long) cell, available_cells);
-			}
-			if (!prev && cell->learning) { //if cell is learning
-				available_cells = add_elem((long) cell, available_cells);
-			}
+	for (a = first; a < last; a++) {
+		int index = learning->indices[a];
+		int b = index % CELL_COUNT; //index of the cell in its column
+		while (c < connected_count && connected[c] < index) {
+			c++;
 		}
-	}
-	if (available_cells != NULL) { //if available cells were found
-		int len = available_cells->len;
-		int rest = len; //number of cells still available
-		long* array = list_to_array(available_cells);
-		free_list(available_cells);
-		while (count > 0 && rest > 0) { //as long as new connections are needed AND available cells are left
-			int i = rand() % len; //pick an available cell at random
-			if (array[i] != -1) { //if cell not yet used
-				Connection* new_connection = malloc(sizeof(Connection)); //allocate new connection
-				new_connection->active_cycle = region->cycle; //set timestamp
-				new_connection->cell = (Cell*) array[i]; //point to chosen cell
-				new_connection->perm = CONNECTION_INITIAL_PERMANENCE; //set initial permanence
-				update->new_connections = add_elem((long) new_connection, update->new_connections); //add new connection to update
-				array[i] = -1; //mark cell as used
-				count--;
-				rest--;
-			}
+		if (b >= cell_from && b <= cell_to && !(c < connected_count && connected[c] == index)) { //if cell is in search space AND not yet connected
+			available_cells[len++] = index;
 		}
-		free(array);
+	}
+	if (len > 0 && count > 0) {
+		update->new_cells = arena_alloc(temporal_update_arena(region), (count < len ? count : len) * sizeof(int));
+	}
+	while (count > 0 && len > 0) { //as long as new connections are needed AND available cells are left
+		int i = rand_r(seed) % len; //pick an available cell at random
+		update->new_cells[update->new_count++] = available_cells[i]; //add new synapse to chosen cell to update
+		available_cells[i] = available_cells[--len]; //replace chosen cell by the last available one
+		count--;
 	}
 }
 
-//marks the connections as active or inactive
+//marks the synapses of the update's segment of the cell as active or inactive
 
-void temporal_add_active_connections(char prev, Update* update) {
+void temporal_add_active_connections(Region* region, Cell* cell, char prev, Update* update) {
 	if (update->segment == NULL) {
 		return;
 	}
-	List* connections = update->segment->connections;
-	while (connections != NULL) {
-		Connection* connection = (Connection*) connections->elem;
-		if (prev && connection->cell->prev_active) {
-			update->active_connections = add_elem((long) connection, update->active_connections);
-		}
-		if (prev && !connection->cell->prev_active) {
-			update->inactive_connections = add_elem((long) connection, update->inactive_connections);
-		}
-		if (!prev && connection->cell->active) {
-			update->active_connections = add_elem((long) connection, update->active_connections);
-		}
-		if (!prev && !connection->cell->active) {
-			update->inactive_connections = add_elem((long) connection, update->inactive_connections);
+	Segment* segment = update->segment;
+	update->synapse_count = segment->synapse_count;
+	int words = (segment->synapse_count + 63) / 64;
+	update->active_synapses = arena_alloc(temporal_update_arena(region), words * sizeof(uint64_t));
+	memset(update->active_synapses, 0, words * sizeof(uint64_t));
+	PackedSDR* states = prev ? region->prev_state->active : region->state->active;
+	int a;
+	for (a = 0; a < segment->synapse_count; a++) {
+		if (packed_is_set(states, cell->synapse_cells[segment->first + a])) {
+			update->active_synapses[a / 64] |= (uint64_t) 1 << (a % 64);
+			update->active_count++;
 		}
-		connections = connections->next;
 	}
 }
 
 //finds the cell inside a column best suitable for becoming the learning cell
-//forms new connections being added to the learning cell when the new update is applied
+//forms new connections being added to the learning cell when the new update is applied, random choices are drawn from "seed"
 
-void temporal_find_learning_cell(Region* region, Column* column, int column_index) {
+void temporal_find_learning_cell(Region* region, Column* column, int column_index, unsigned int* seed) {
 	Cell* best_cell = NULL; //cell with the most active segment
 	int best_index = -1;
 	Segment* best_segment = NULL; //most active segment
@@ -321,6 +990,7 @@ void temporal_find_learning_cell(Region* region, Column* column, int column_inde
 	Cell* smallest_cell = NULL; //cell with the least amount of segments
 	int smallest_index = -1;
 	int smallest_len = 0; //lowest amount of segments
+	char counted = region->count_cycle == region->cycle - 1; //the prediction of the previous cycle cached the counts
 	int a;
 	for (a = 0; a < CELL_COUNT; a++) {
 		Cell* cell = &(column->cells[a]);
@@ -329,13 +999,15 @@ void temporal_find_learning_cell(Region* region, Column* column, int column_inde
 		while (segments != NULL) {
 			Segment* segment = (Segment*) segments->elem;
 			int active = 0; //segment's activity
-			List* connections = segment->connections;
-			while (connections != NULL) {
-				Connection* connection = (Connection*) connections->elem;
-				if (connection->cell->prev_active) {
-					active++;
+			if (counted) {
+				active = segment->count_cycle == region->cycle - 1 ? segment->potential_count : 0;
+			} else {
+				int b;
+				for (b = segment->first; b < segment->first + segment->synapse_count; b++) {
+					if (packed_is_set(region->prev_state->active, cell->synapse_cells[b])) {
+						active++;
+					}
 				}
-				connections = connections->next;
 			}
 			if (active >= SEGMENT_LEARNING_THRESHOLD && active > best_active) { //if activity reaches learning threshold AND activity is the highest
 				best_cell = cell;
@@ -345,7 +1017,7 @@ void temporal_find_learning_cell(Region* region, Column* column, int column_inde
 			}
 			segments = segments->next;
 		}
-		if (smallest_cell == NULL || len < smallest_len || (len == smallest_len && rand() % 2 == 0)) { //if cell is the smallest cell
+		if (smallest_cell == NULL || len < smallest_len || (len == smallest_len && rand_r(seed) % 2 == 0)) { //if cell is the smallest cell
 			smallest_cell = cell;
 			smallest_index = a;
 			smallest_len = len;
@@ -360,26 +1032,20 @@ void temporal_find_learning_cell(Region* region, Column* column, int column_inde
 		chosen_cell = smallest_cell;
 		chosen_index = smallest_index;
 	}
-	chosen_cell->learning = chosen_cell->remain_learning;
-	Update* update = malloc(sizeof(Update));
-	update->active_cycle = region->cycle;
-	update->segment = NULL;
-	update->active_connections = NULL;
-	update->new_connections = NULL;
-	update->inactive_connections = NULL;
+	temporal_set_learning(region, chosen_cell->index);
+	if (!ENABLE_LEARNING) { //updates are only applied while learning
+		return;
+	}
+	Update* update = temporal_new_update(region, chosen_cell, best_segment); //submit update
 	if (best_segment != NULL) {
 		best_segment->update++;
-		update->segment = best_segment;
-		temporal_add_active_connections(1, update); //remember which connections were active
+		temporal_add_active_connections(region, chosen_cell, 1, update); //remember which synapses were active
 	}
-	int count =
-			update->active_connections != NULL ?
-					SEGMENT_NEW_CONNECTIONS - update->active_connections->len : SEGMENT_NEW_CONNECTIONS; //number of new connections to be formed
-	temporal_add_new_connections(region, column_index, chosen_index, 1, update, count); //form new connections
-	chosen_cell->segment_updates = add_elem((long) update, chosen_cell->segment_updates); //submit update
+	int count = SEGMENT_NEW_CONNECTIONS - update->active_count; //number of new synapses to be formed
+	temporal_add_new_connections(region, column_index, chosen_index, 1, update, count, seed); //form new connections
 }
 
-//finds the most active segment inside a cell
+//finds the most active segment inside a cell, the segments' states must have been computed by temporal_activate_segments() in this cycle
 
 Segment* temporal_best_segment(Cell* cell, char learning) {
 	Segment* best = NULL;
@@ -395,45 +1061,80 @@ Segment* temporal_best_segment(Cell* cell, char learning) {
 	return best;
 }
 
-//activates the cells of the winning columns and finds a learning cell in each winning column
+//activates the cells of the winning columns between index "from" and "to" and finds a learning cell in each of them
+//"job" selects the burst counter and the random stream, call temporal_merge_activation() once all columns are done
 
-void temporal_activate_region(Region* region) {
-	List* active_columns = region->active_columns;
-	while (active_columns != NULL) { //iterate through active columns
-		Column* column = &(region->columns[active_columns->elem]); //get column from index
+void temporal_activate_columns(Region* region, int from, int to, int job) {
+	RegionJob* region_job = &(region->jobs[job]);
+	int i = 0;
+	while (i < region->active_column_count && region->active_columns[i] < from) { //skip winners of other jobs
+		i++;
+	}
+	for (; i < region->active_column_count && region->active_columns[i] <= to; i++) { //iterate through active columns
+		Column* column = &(region->columns[region->active_columns[i]]); //get column from index
 		char predicted = 0; //column predicted its activation
 		char chosen = 0; //learning cell chosen
 		int a;
 		for (a = 0; a < CELL_COUNT; a++) {
 			Cell* cell = &(column->cells[a]);
-			if (cell->prev_predictive) { //if cell was predictive in previous timestep
+			if (packed_is_set(region->prev_state->predictive, cell->index)) { //if cell was predictive in previous timestep
 				predicted = 1;
-				cell->active = cell->remain_active; //activate cell
-				temporal_activate_segments(cell, region->cycle); //activate its segments
+				temporal_set_active(region, cell->index); //activate cell
+				temporal_activate_segments(region, cell, region->cycle); //activate its segments
 				Segment* segment = temporal_best_segment(cell, 0); //find its best segment
 				if (segment != NULL && segment->prev_learning) { //continue learning
 					chosen = 1;
-					cell->learning = cell->remain_learning;
+					temporal_set_learning(region, cell->index);
 				}
 			}
 		}
 		if (!predicted) { //burst column if no predictive cell
-			region->bursts++;
+			region_job->bursts++;
 			for (a = 0; a < CELL_COUNT; a++) {
-				Cell* cell = &(column->cells[a]);
-				cell->active = cell->remain_active;
+				temporal_set_active(region, column->cells[a].index);
 			}
 		}
 		if (!chosen) { //find learning cell if none yet chosen
-			temporal_find_learning_cell(region, column, active_columns->elem);
+			temporal_find_learning_cell(region, column, region->active_columns[i], &(region_job->seed));
 		}
-		active_columns = active_columns->next;
 	}
 }
 
-//computes the predictive state of cells inside the columns between index "from" and "to", schedules an update for active segments inside predictive cells
+//adds the bursts of all jobs to the region's bursts and collects the active and learning cells
 
-void temporal_predict_cells(Region* region, int from, int to) {
+void temporal_merge_activation(Region* region) {
+	int a;
+	for (a = 0; a < region->job_count; a++) {
+		region->bursts += region->jobs[a].bursts;
+		region->jobs[a].bursts = 0;
+	}
+	packed_fill_sparse(region->state->active, region->state->active_cells);
+	packed_fill_sparse(region->state->learning, region->state->learning_cells);
+}
+
+//activates the cells of the winning columns and finds a learning cell in each winning column
+
+void temporal_activate_region(Region* region) {
+	temporal_activate_columns(region, 0, COLUMN_COUNT - 1, 0);
+	temporal_merge_activation(region);
+}
+
+//sets the cell of an active segment to predictive state, schedules an update for the segment
+
+void temporal_predict_segment(Region* region, Cell* cell, Segment* segment) {
+	temporal_set_predictive(region, cell->index); //set parent cell to predictive state
+	if (ENABLE_LEARNING) {
+		//schedule reinforcement update
+		segment->update++;
+		Update* update = temporal_new_update(region, cell, segment);
+		temporal_add_active_connections(region, cell, 0, update);
+	}
+}
+
+//computes the predictive state of cells inside the columns between index "from" and "to" by scanning all synapses of their segments
+//the counts of all segments are cached for the next cycle
+
+void temporal_predict_cells_scan(Region* region, int from, int to) {
 	int a;
 	for (a = from; a <= to; a++) {
 		Column* column = &(region->columns[a]);
@@ -444,28 +1145,31 @@ void temporal_predict_cells(Region* region, int from, int to) {
 			while (segments != NULL) {
 				Segment* segment = (Segment*) segments->elem;
 				int active = 0; //segment's activity
-				List* connections = segment->connections;
-				while (connections != NULL) {
-					Connection* connection = (Connection*) connections->elem;
-					if (connection->perm >= CONNECTION_PERMANENCE_THRESHOLD && connection->cell->active) { //if connection permanence reaches threshold AND connection points to active cell
-						active++;
+				int potential = 0; //synapses to active cells regardless of their permanence
+				int learning = 0; //connected synapses to learning cells
+				char weak = segment->connected_count < SEGMENT_ACTIVATION_THRESHOLD; //segment cannot become active, only potential synapses count
+				int c;
+				for (c = segment->first; c < segment->first + segment->synapse_count; c++) {
+					if (weak) {
+						potential += packed_is_set(region->state->active, cell->synapse_cells[c]);
+						continue;
+					}
+					char connected = cell->synapse_perms[c] >= CONNECTION_PERM_THRESHOLD;
+					if (packed_is_set(region->state->active, cell->synapse_cells[c])) { //if synapse points to active cell
+						potential++;
+						active += connected;
+					}
+					if (connected && packed_is_set(region->state->learning, cell->synapse_cells[c])) {
+						learning++;
 					}
-					connections = connections->next;
 				}
+				segment->count_cycle = region->cycle; //cache the counts for the next cycle's activation
+				segment->weak = weak;
+				segment->active_count = active;
+				segment->potential_count = potential;
+				segment->learning_count = learning;
 				if (active >= SEGMENT_ACTIVATION_THRESHOLD) { //if segment's activity reaches activation threshold
-					cell->predictive = cell->remain_predictive; //set parent cell to predictive state
-					if (ENABLE_LEARNING) {
-						//schedule reinforcement update
-						segment->update++;
-						Update* update = malloc(sizeof(Update));
-						update->active_cycle = region->cycle;
-						update->segment = segment;
-						update->active_connections = NULL;
-						update->new_connections = NULL;
-						update->inactive_connections = NULL;
-						temporal_add_active_connections(0, update);
-						cell->segment_updates = add_elem((long) update, cell->segment_updates);
-					}
+					temporal_predict_segment(region, cell, segment);
 				}
 				segments = segments->next;
 			}
@@ -473,67 +1177,147 @@ void temporal_predict_cells(Region* region, int from, int to) {
 	}
 }
 
-//positively reinforces the given List of connections if "inc" is set, otherwise negatively reinforces
+//computes the predictive state of cells inside the columns between index "from" and "to" through the reverse index
+//only the targets of active and learning cells and the cells with a segment reaching the activation threshold are visited
+//the counts of the reached segments are cached for the next cycle, segments not reached keep an older count_cycle and count as 0
+//predicted cells are processed in ascending order and their segments in list order, so updates are scheduled as by temporal_predict_cells_scan()
 
-void temporal_reinforce_connections(List* connections, char inc) {
-	List* node = connections;
-	while (node != NULL) {
-		Connection* connection = (Connection*) node->elem;
-		if (inc) {
-			connection->perm += CONNECTION_PERMANENCE_INC;
-			connection->perm = connection->perm > 1.0 ? 1.0 : connection->perm;
-		} else {
-			connection->perm -= CONNECTION_PERMANENCE_DEC;
-			connection->perm = connection->perm < 0.0 ? 0.0 : connection->perm;
+void temporal_predict_cells_indexed(Region* region, int from, int to, int job) {
+	RegionJob* region_job = &(region->jobs[job]);
+	region_job->predicted_count = 0;
+	int first = from * CELL_COUNT; //lowest cell index of the columns
+	int last = to * CELL_COUNT + CELL_COUNT - 1; //highest cell index of the columns
+	int a;
+	for (a = 0; a < region->state->active_cells->count; a++) { //count the synapses to active cells per segment
+		Cell* presynaptic = &(region->cells[region->state->active_cells->indices[a]]);
+		int b;
+		for (b = temporal_find_target(presynaptic, first);
+				b < presynaptic->target_count && presynaptic->targets[b].cell <= last; b++) {
+			Segment* segment = presynaptic->targets[b].segment;
+			temporal_reset_counts(segment, region->cycle);
+			segment->potential_count++;
+			if (presynaptic->targets[b].connected && !segment->weak && ++segment->active_count == SEGMENT_ACTIVATION_THRESHOLD) { //if segment's activity reaches activation threshold
+				if (region_job->predicted_count == region_job->predicted_capacity) {
+					region_job->predicted_capacity = region_job->predicted_capacity > 0 ? region_job->predicted_capacity * 2 : 64;
+					region_job->predicted_cells = realloc(region_job->predicted_cells, region_job->predicted_capacity * sizeof(int));
+				}
+				region_job->predicted_cells[region_job->predicted_count++] = presynaptic->targets[b].cell;
+			}
+		}
+	}
+	for (a = 0; a < region->state->learning_cells->count; a++) { //count the connected synapses to learning cells per segment
+		Cell* presynaptic = &(region->cells[region->state->learning_cells->indices[a]]);
+		int b;
+		for (b = temporal_find_target(presynaptic, first);
+				b < presynaptic->target_count && presynaptic->targets[b].cell <= last; b++) {
+			if (presynaptic->targets[b].connected) {
+				Segment* segment = presynaptic->targets[b].segment;
+				temporal_reset_counts(segment, region->cycle);
+				segment->learning_count += !segment->weak;
+			}
+		}
+	}
+	if (region_job->predicted_count > 1) { //predicted_cells may be NULL while empty
+		qsort(region_job->predicted_cells, region_job->predicted_count, sizeof(int), comp_ints);
+	}
+	for (a = 0; a < region_job->predicted_count; a++) {
+		if (a > 0 && region_job->predicted_cells[a] == region_job->predicted_cells[a - 1]) { //cell already processed
+			continue;
+		}
+		Cell* cell = &(region->cells[region_job->predicted_cells[a]]);
+		List* segments = cell->segments;
+		while (segments != NULL) {
+			Segment* segment = (Segment*) segments->elem;
+			if (segment->count_cycle == region->cycle && segment->active_count >= SEGMENT_ACTIVATION_THRESHOLD) {
+				temporal_predict_segment(region, cell, segment);
+			}
+			segments = segments->next;
 		}
-		node = node->next;
 	}
 }
 
-//if "positive_reinforcement" is set: positively reinforces connections marked as active and new inside the update, negatively reinforces the connections marked as inactive
-//otherwise: negatively reinforces connections marked as active inside the update
-//also forms new segments if required and adds new connections to their belonging segments
+//computes the predictive state of cells inside the columns between index "from" and "to", schedules an update for active segments inside predictive cells
+//"job" selects the scratch data used with the reverse index
 
-void temporal_adapt_segments(Cell* cell, char positive_reinforcement, long cycle) {
-	List* segment_updates = cell->segment_updates;
-	while (segment_updates != NULL) {
-		Update* update = (Update*) segment_updates->elem;
-		if (positive_reinforcement) {
-			temporal_reinforce_connections(update->active_connections, 1);
-			temporal_reinforce_connections(update->new_connections, 1);
-			if (update->segment != NULL) {
-				temporal_reinforce_connections(update->inactive_connections, 0);
+void temporal_predict_cells(Region* region, int from, int to, int job) {
+	if (CONNECTION_REVERSE_INDEX && SEGMENT_ACTIVATION_THRESHOLD > 0) { //segments without active synapses are not found through the index
+		temporal_predict_cells_indexed(region, from, to, job);
+	} else {
+		temporal_predict_cells_scan(region, from, to);
+	}
+}
+
+//collects the predictive cells, call after temporal_predict_cells() ran for all columns
+
+void temporal_merge_prediction(Region* region) {
+	packed_fill_sparse(region->state->predictive, region->state->predictive_cells);
+}
+
+//collects the cells of the current and previous states, required after loading
+
+void temporal_collect_cells(Region* region) {
+	int a;
+	for (a = 0; a < 2; a++) {
+		CellStates* states = &(region->state_buffers[a]);
+		packed_fill_sparse(states->active, states->active_cells);
+		packed_fill_sparse(states->predictive, states->predictive_cells);
+		packed_fill_sparse(states->learning, states->learning_cells);
+	}
+}
+
+//if "positive_reinforcement" is set: positively reinforces synapses marked as active and new inside the update, negatively reinforces the synapses marked as inactive
+//otherwise: negatively reinforces synapses marked as active inside the update
+//also forms new segments if required and adds new synapses to their belonging segments
+//with CELL_MAX_SEGMENTS the least recently active segment is evicted for a new segment, the update is dropped if all segments have pending updates
+
+void temporal_adapt_segments(Region* region, Cell* cell, char positive_reinforcement, long cycle) {
+	Update* update = cell->segment_updates;
+	while (update != NULL) {
+		Segment* segment = update->segment;
+		if (segment != NULL) { //if segment already exists
+			perm_t* perms = cell->synapse_perms + segment->first;
+			int a;
+			for (a = 0; a < update->synapse_count; a++) {
+				perm_t old = perms[a];
+				if ((update->active_synapses[a / 64] >> (a % 64)) & 1) {
+					perms[a] = positive_reinforcement ?
+							perm_add(perms[a], CONNECTION_PERM_INC) : perm_sub(perms[a], CONNECTION_PERM_DEC);
+				} else if (positive_reinforcement) {
+					perms[a] = perm_sub(perms[a], CONNECTION_PERM_DEC);
+				}
+				char connected = perms[a] >= CONNECTION_PERM_THRESHOLD;
+				if ((old >= CONNECTION_PERM_THRESHOLD) != connected) { //if synapse crossed the threshold
+					int presynaptic = cell->synapse_cells[segment->first + a];
+					temporal_reindex_synapse(region, presynaptic, cell->index, segment, connected);
+					temporal_count_connection(segment, region->state, region->cycle, presynaptic, connected ? 1 : -1);
+					segment->connected_count += connected ? 1 : -1;
+				}
 			}
+			segment->update--;
 		} else {
-			temporal_reinforce_connections(update->active_connections, 0);
+			if (CELL_MAX_SEGMENTS > 0 && cell->segments != NULL && cell->segments->len >= CELL_MAX_SEGMENTS) { //make room for the new segment
+				Segment* oldest = temporal_oldest_segment(cell);
+				if (oldest != NULL) {
+					__atomic_fetch_add(&(region->evicted_segments), 1, __ATOMIC_RELAXED); //jobs of the thread pool share the counters
+					__atomic_fetch_add(&(region->evicted_synapses), oldest->synapse_count, __ATOMIC_RELAXED);
+					temporal_remove_segment(region, cell, oldest);
+				}
+			}
+			if (CELL_MAX_SEGMENTS <= 0 || cell->segments == NULL || cell->segments->len < CELL_MAX_SEGMENTS) {
+				segment = temporal_new_segment(region, cell, cycle); //add new segment to parent cell
+			}
 		}
-		if (update->segment != NULL) { //if segment already exists
-			update->segment->update--;
-			update->segment->connections = merge_lists(update->segment->connections, update->new_connections); //merge current connections and new connections
-			update->new_connections = NULL;
-		} else {
-			Segment* new_segment = malloc(sizeof(Segment)); //allocate new segment
-			new_segment->update = 0;
-			new_segment->active_cycle = cycle;
-			new_segment->activity = 0;
-			new_segment->active = 0;
-			new_segment->prev_active = 0;
-			new_segment->learning = 0;
-			new_segment->prev_learning = 0;
-			new_segment->connections = update->new_connections; //add new connections to new segment
-			cell->segments = add_elem((long) new_segment, cell->segments); //add new segment to parent cell
-		}
-		//free update
-		free_list(update->active_connections);
-		free_list(update->inactive_connections);
-		free(update);
-		segment_updates = segment_updates->next;
-	}
-	free_list(cell->segment_updates);
-	cell->segment_updates = NULL;
+		if (segment != NULL) {
+			perm_t perm = positive_reinforcement ? perm_add(CONNECTION_PERM_INITIAL, CONNECTION_PERM_INC) : CONNECTION_PERM_INITIAL; //new synapses are reinforced like active ones
+			temporal_add_synapses(region, cell, segment, update->new_cells, update->new_count, perm, update->active_cycle); //add new synapses to segment
+		}
+		update = update->next;
+	}
+	cell->segment_updates = NULL; //the updates are reclaimed with the arenas
 }
 
 //applies all scheduled updates for cells inside columns between index "from" and "to"
+//the updates kept for later cycles are carried over into the arena of the current cycle
 
 void temporal_apply_updates(Region* region, int from, int to) {
 	int a;
@@ -542,32 +1326,40 @@ void temporal_apply_updates(Region* region, int from, int to) {
 		int b;
 		for (b = 0; b < CELL_COUNT; b++) {
 			Cell* cell = &(column->cells[b]);
-			if (cell->learning) { //if cell is learning
-				temporal_adapt_segments(cell, 1, region->cycle);
-			} else if (!cell->active && (cell->prev_predictive == 1)) { //if cell incorrectly predicted its activation
-				temporal_adapt_segments(cell, 0, region->cycle);
+			if (packed_is_set(region->state->learning, cell->index)) { //if cell is learning
+				temporal_adapt_segments(region, cell, 1, region->cycle);
+			} else if (!packed_is_set(region->state->active, cell->index)
+					&& packed_is_set(region->prev_state->predictive, cell->index)
+					&& temporal_prev_predictive_until(region, cell->index) == region->cycle) { //if cell incorrectly predicted its activation, which expired
+				temporal_adapt_segments(region, cell, 0, region->cycle);
+			} else if (cell->segment_updates != NULL) {
+				temporal_carry_updates(region, cell);
 			}
 		}
 	}
 }
 
-void temporal_overlap(Region* region) {
-	int tcount = 0;
-	int count = 0;
-	int a;
-	for (a = 0; a < COLUMN_COUNT; a++) {
-		Column* column = &(region->columns[a]);
-		int b;
-		for (b = 0; b < CELL_COUNT; b++) {
-			Cell* cell = &(column->cells[b]);
-			if (cell->predictive) {
-				tcount++;
-			}
-			if (cell->prev_predictive && cell->predictive) {
-				count++;
-			}
-		}
+//runs the temporal memory of one cycle on the columns between index "from" and "to": activation, prediction and, if learning is enabled, update application
+//the jobs only wait for each other where a phase depends on all columns: prediction reads the active and learning cells of the whole region,
+//and updates must not change the reverse index before all predictions are done
+//all jobs of the round must run at the same time, so create as many jobs as the thread pool has threads
+
+void temporal_cycle_columns(Region* region, int from, int to, int job) {
+	temporal_activate_columns(region, from, to, job);
+	if (pthread_barrier_wait(region->barrier) == PTHREAD_BARRIER_SERIAL_THREAD) { //one job merges the activation of all jobs
+		temporal_merge_activation(region);
+	}
+	pthread_barrier_wait(region->barrier);
+	temporal_predict_cells(region, from, to, job);
+	if (ENABLE_LEARNING) {
+		pthread_barrier_wait(region->barrier);
+		temporal_apply_updates(region, from, to);
 	}
+}
+
+void temporal_overlap(Region* region) {
+	int tcount = region->state->predictive_cells->count;
+	int count = sparse_overlap(region->prev_state->predictive_cells, region->state->predictive_cells);
 	region->overlap = count * 1.0 / tcount;
 	printf("prediction overlap: %d/%d = %f\n", count, tcount, count * 1.0 / tcount);
 	if (region->overlap < OVERLAP_THRESHOLD) {
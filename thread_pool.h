@@ -26,6 +26,7 @@ typedef struct tp_job {
 	pthread_cond_t* jcond;
 	Region* region;
 	char cmd;
+	int id; //index of the job in its round, selects the job's scratch data in the region
 	int from;
 	int to;
 } tp_job;
@@ -61,20 +62,29 @@ void exec_job(tp_job* job) {
 		spatial_boost_region(job->region, job->from, job->to);
 		break;
 	case 2:
-		temporal_predict_cells(job->region, job->from, job->to);
+		temporal_predict_cells(job->region, job->from, job->to, job->id);
 		break;
 	case 3:
 		temporal_apply_updates(job->region, job->from, job->to);
 		break;
-	case 4:
-		temporal_region_cycle(job->region, job->from, job->to);
-		break;
 	case 5:
 		temporal_region_forget_updates(job->region, job->from, job->to);
 		break;
 	case 6:
 		temporal_region_forget_segments(job->region, job->from, job->to);
 		break;
+	case 7:
+		spatial_histogram_job(job->region, job->from, job->to, job->id);
+		break;
+	case 8:
+		spatial_activate_job(job->region, job->from, job->to, job->id);
+		break;
+	case 9:
+		temporal_activate_columns(job->region, job->from, job->to, job->id);
+		break;
+	case 10:
+		temporal_cycle_columns(job->region, job->from, job->to, job->id);
+		break;
 	}
 	return;
 }
@@ -82,6 +92,7 @@ void exec_job(tp_job* job) {
 //internal function, main loop of thread pool
 void* loop(long* p) {
 	thread_pool* tp = (thread_pool*) p[0];
+	thread_slot = (int) p[1] + 1; //select this thread's slabs
 	free(p);
 	while (1) {
 		pthread_mutex_lock(tp->qmut);